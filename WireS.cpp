@@ -37,6 +37,9 @@
 // Disclaimer: The author only confirmed the library to work with ATtiny1634, ATtiny841, and ATtiny828.
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
 #include "WireS.h"
 
 //#define TWI_HIGH_NOISE_MODE _BV(TWHNM) // only for ATtiny441/841 or ATtiny828
@@ -51,208 +54,1663 @@
 #define CLEAR_TENBIT do { i2c->Addr &= 0x7FFF; } while(0)
 #define IS_TENBIT (i2c->Addr & 0x8000)
 
+// handler invocation - either through the function pointer registered by Wire.onXxx()
+//                      or a direct call to the function bound by I2C_STATIC_ON_XXX
+#if defined(I2C_STATIC_ON_ADDR_RECEIVE)
+boolean I2C_STATIC_ON_ADDR_RECEIVE(uint16_t, uint8_t);
+#define I2C_HAS_ON_ADDR_RECEIVE true
+#define I2C_ON_ADDR_RECEIVE I2C_STATIC_ON_ADDR_RECEIVE
+#else
+#define I2C_HAS_ON_ADDR_RECEIVE (i2c->user_onAddrReceive != (void *)NULL)
+#define I2C_ON_ADDR_RECEIVE i2c->user_onAddrReceive
+#endif
+#if defined(I2C_STATIC_ON_RECEIVE)
+void I2C_STATIC_ON_RECEIVE(size_t);
+#define I2C_HAS_ON_RECEIVE true
+#define I2C_ON_RECEIVE I2C_STATIC_ON_RECEIVE
+#else
+#define I2C_HAS_ON_RECEIVE (i2c->user_onReceive != (void *)NULL)
+#define I2C_ON_RECEIVE i2c->user_onReceive
+#endif
+#if defined(I2C_STATIC_ON_RECEIVE_CHUNK)
+void I2C_STATIC_ON_RECEIVE_CHUNK(const uint8_t*, size_t);
+#define I2C_HAS_ON_RECEIVE_CHUNK true
+#define I2C_ON_RECEIVE_CHUNK I2C_STATIC_ON_RECEIVE_CHUNK
+#else
+#define I2C_HAS_ON_RECEIVE_CHUNK (i2c->user_onReceiveChunk != (void *)NULL)
+#define I2C_ON_RECEIVE_CHUNK i2c->user_onReceiveChunk
+#endif
+#if defined(I2C_STATIC_ON_REQUEST)
+void I2C_STATIC_ON_REQUEST(void);
+#define I2C_HAS_ON_REQUEST true
+#define I2C_ON_REQUEST I2C_STATIC_ON_REQUEST
+#else
+#define I2C_HAS_ON_REQUEST (i2c->user_onRequest != (void *)NULL)
+#define I2C_ON_REQUEST i2c->user_onRequest
+#endif
+#if defined(I2C_STATIC_ON_REQUEST_MORE)
+void I2C_STATIC_ON_REQUEST_MORE(void);
+#define I2C_HAS_ON_REQUEST_MORE true
+#define I2C_ON_REQUEST_MORE I2C_STATIC_ON_REQUEST_MORE
+#else
+#define I2C_HAS_ON_REQUEST_MORE (i2c->user_onRequestMore != (void *)NULL)
+#define I2C_ON_REQUEST_MORE i2c->user_onRequestMore
+#endif
+#if defined(I2C_STATIC_ON_STOP)
+void I2C_STATIC_ON_STOP(void);
+#define I2C_HAS_ON_STOP true
+#define I2C_ON_STOP I2C_STATIC_ON_STOP
+#else
+#define I2C_HAS_ON_STOP (i2c->user_onStop != (void *)NULL)
+#define I2C_ON_STOP i2c->user_onStop
+#endif
+#if defined(I2C_STATIC_ON_GENERAL_CALL)
+void I2C_STATIC_ON_GENERAL_CALL(uint8_t);
+#define I2C_HAS_ON_GENERAL_CALL true
+#define I2C_ON_GENERAL_CALL I2C_STATIC_ON_GENERAL_CALL
+#else
+#define I2C_HAS_ON_GENERAL_CALL (i2c->user_onGeneralCall != (void *)NULL)
+#define I2C_ON_GENERAL_CALL i2c->user_onGeneralCall
+#endif
+
+#if defined(I2C_STATS)
+#define I2C_STAT(counter) do { i2c->stats.counter++; } while(0)
+#else
+#define I2C_STAT(counter) do{}while(0)
+#endif
+
+#define I2C_SNAPSHOT_NONE 0xFF // snapshotSending: no master read in progress
+
+#if defined(I2C_TRACE_LENGTH)
+#define I2C_TRACE_PAUSED_USER 0x01 // by dumpTrace()
+#define I2C_TRACE_PAUSED_BUS  0x02 // by master reading I2C_TRACE_REGISTER
+#define I2C_TRACE(type, value) i2c_trace(i2c, (type), (value))
+#else
+#define I2C_TRACE(type, value) do{}while(0)
+#endif
+
+#if defined(I2C_INTR_FLAG_PIN)
+static volatile uint8_t* i2c_intr_flag_port;
+static uint8_t i2c_intr_flag_mask;
+#endif
+
+#if defined(I2C_TX_SOURCE)
+#define TX_SOURCE_ACTIVE (i2c->txSourceKind != I2C_SOURCE_NONE)
+#else
+#define TX_SOURCE_ACTIVE false
+#endif
+
+// i2c->smbus flags
+#define I2C_SMBUS_PEC      0x01 // PEC is enabled
+#define I2C_SMBUS_PEC_SENT 0x02 // PEC has been appended to the current master read
+
+// i2c->state flags
+#define I2C_STATE_HANDLER 0x01 // onRequestMore()/onReceiveChunk() handler is running with interrupts enabled
+#define I2C_STATE_REGPTR  0x02 // next byte received is register pointer
+#define I2C_STATE_DEFERRED 0x04 // deferred mode; handlers are called by poll()
+#define I2C_STATE_PHASE   0x08 // deferred mode; a transaction record is open
+#define I2C_STATE_STAGE   0x10 // deferred mode; poll() is to call onRequest() to stage a response
+#define I2C_STATE_DEVICES 0x20 // device table is in use
+#define I2C_STATE_TENBIT  0x40 // i2c->Addr is a 10-bit address
+#define I2C_STATE_GENERAL 0x80 // next byte received is the first of a general call write
+
 struct i2cStruct i2c_tinyS::i2cData;
 
 // ------------------------------------------------------------------------------------------------------
-// Constructor/Destructor
+// Constructor/Destructor
+//
+i2c_tinyS::i2c_tinyS()
+{
+    i2c = &i2cData;
+}
+
+i2c_tinyS::~i2c_tinyS()
+{
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Initialize I2C - initializes I2C as two address or address range Slave
+// return: none
+// parameters:
+//      address = 7bit address for specifying 1st Slave address
+//      mask = 8bit integer;
+//             if bit[0]==1 then bit[7:1] 2nd Slave address
+//             if bit[0]==0 then bit[7:1] mask bits for address
+//
+void i2c_tinyS::begin_(struct i2cStruct* i2c, uint8_t address, uint8_t mask)
+{
+    I2C_INTR_FLAG_INIT; // init I2C interrupt flag if used
+    TWSA = (address << 1);
+    TWSAM = mask; // if mask == 0 then only one address
+    i2c->startCount = -1;
+    TWSCRA = (_BV(TWSHE) | _BV(TWDIE) | _BV(TWASIE) | _BV(TWEN) | _BV(TWSIE));
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Write - write data to Tx buffer
+// return: 1=success, 0=fail
+// parameters:
+//      data = data byte
+//
+size_t i2c_tinyS::write(uint8_t data)
+{
+    size_t n = 0;
+    uint8_t sreg = SREG;
+    cli(); // the ISR may be sending from Tx buffer meanwhile
+    if((i2c_tx_index_t)(i2c->txBufferLength - i2c->txBufferIndex) < I2C_TX_BUFFER_LENGTH)
+    {
+        i2c->txBuffer[i2c->txBufferLength++ & I2C_TX_BUFFER_MASK] = data;
+        n = 1;
+    }
+    SREG = sreg;
+    return n;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Write Array - write length number of bytes from data array to Tx buffer
+// return: number of bytes written
+// parameters:
+//      data = pointer to uint8_t array of data
+//      length = number of bytes to write
+//
+size_t i2c_tinyS::write(const uint8_t* data, size_t quantity)
+{
+    uint8_t sreg = SREG;
+    cli(); // the ISR may be sending from Tx buffer or Tx source meanwhile
+    size_t avail = I2C_TX_BUFFER_LENGTH - (i2c_tx_index_t)(i2c->txBufferLength - i2c->txBufferIndex);
+
+    if(quantity > avail)
+    {
+        quantity = avail; // truncate to space avail if needed
+    }
+    for(size_t count=quantity; count; count--)
+        i2c->txBuffer[i2c->txBufferLength++ & I2C_TX_BUFFER_MASK] = *data++;
+    SREG = sreg;
+    return quantity;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Write Value - write a multi-byte value to Tx buffer, all or nothing
+// return: number of bytes written, 0 if no room for all
+// parameters:
+//      value = pointer to the value (little endian, as AVR is)
+//      size = size of the value
+//      bigEndian = true to write MSB first
+//
+size_t i2c_tinyS::writeValue_(struct i2cStruct* i2c, const void* value, uint8_t size, boolean bigEndian)
+{
+    const uint8_t* p = (const uint8_t*)value;
+    size_t n = 0;
+    uint8_t sreg = SREG;
+    cli(); // the ISR may be sending from Tx buffer meanwhile
+    i2c_tx_index_t length = i2c->txBufferLength;
+    if (I2C_TX_BUFFER_LENGTH - (i2c_tx_index_t)(length - i2c->txBufferIndex) >= size) {
+        if (bigEndian) {
+            p += size;
+            for (n = size; n; n--) {
+                i2c->txBuffer[length++ & I2C_TX_BUFFER_MASK] = *--p;
+            }
+        } else {
+            for (n = size; n; n--) {
+                i2c->txBuffer[length++ & I2C_TX_BUFFER_MASK] = *p++;
+            }
+        }
+        i2c->txBufferLength = length;
+        n = size;
+    }
+    SREG = sreg;
+    return n;
+}
+
+
+#if defined(I2C_TX_SOURCE)
+// ------------------------------------------------------------------------------------------------------
+// Set Tx Source - send bytes straight from RAM, PROGMEM, or EEPROM after Tx buffer is emptied
+// parameters:
+//      data = pointer to the source (EEPROM address for I2C_SOURCE_EEPROM)
+//      length = size of the source
+//      kind = I2C_SOURCE_RAM, I2C_SOURCE_PROGMEM, or I2C_SOURCE_EEPROM, optionally or'ed with
+//             I2C_SOURCE_WRAP to restart from the beginning of the source after its end
+//      start = offset of the first byte to send
+//
+void i2c_tinyS::setTxSource_(struct i2cStruct* i2c, const void* data, size_t length, uint8_t kind, size_t start)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->txSource = (const uint8_t*)data;
+    i2c->txSourceLength = length;
+    i2c->txSourceIndex = start;
+    i2c->txSourceKind = (start < length && (kind & ~I2C_SOURCE_WRAP) <= I2C_SOURCE_LAST ? kind : I2C_SOURCE_NONE);
+    SREG = sreg;
+}
+#endif
+
+
+#if defined(I2C_REGISTER_MAP)
+// ------------------------------------------------------------------------------------------------------
+// Set Registers - let the ISR serve a register file by itself
+// parameters:
+//      regs = pointer to register array, or NULL to go back to handler mode
+//      size = number of registers (1 to 255)
+//      writeMask = pointer to array of per-register write masks (bits set are writable by master),
+//                  or NULL if all bits are writable
+//
+void i2c_tinyS::setRegisters_(struct i2cStruct* i2c, volatile uint8_t* regs, uint8_t size, const uint8_t* writeMask)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->regs = (size ? regs : (volatile uint8_t*)NULL);
+    i2c->regSize = size;
+    i2c->regMask = writeMask;
+    i2c->regPointer = 0;
+    i2c->regCount = 0;
+    i2c->state &= ~I2C_STATE_REGPTR;
+    SREG = sreg;
+}
+
+
+#if I2C_REG_QUEUE_LENGTH
+// ------------------------------------------------------------------------------------------------------
+// Get Register Write - get the oldest record of registers written by master
+// return: true if a record is returned, false if none
+// parameters:
+//      first = pointer to store the first register written
+//      count = pointer to store the number of registers written (from first, wrapping around)
+//
+boolean i2c_tinyS::getRegisterWrite_(struct i2cStruct* i2c, uint8_t* first, uint8_t* count)
+{
+    uint8_t tail = i2c->regQueueTail;
+    if (tail == i2c->regQueueHead) return false;
+    *first = i2c->regQueue[tail & (I2C_REG_QUEUE_LENGTH - 1)].first;
+    *count = i2c->regQueue[tail & (I2C_REG_QUEUE_LENGTH - 1)].count;
+    i2c->regQueueTail = tail + 1;
+    return true;
+}
+#endif
+#endif
+
+
+#if defined(I2C_GENERAL_CALL)
+// ------------------------------------------------------------------------------------------------------
+// Set General Call - enable or disable the recognition of the general call address (LSB of TWSA)
+// parameters:
+//      enable = true to respond to general call
+//
+void i2c_tinyS::setGeneralCall_(struct i2cStruct* i2c, boolean enable)
+{
+    if (enable) {
+        TWSA |= _BV(0);
+    } else {
+        TWSA &= ~_BV(0);
+    }
+}
+#endif
+
+
+#if defined(I2C_SLEEP)
+// ------------------------------------------------------------------------------------------------------
+// Sleep Until Activity - sleep until an interrupt wakes the device.  Between transactions I2C_SLEEP_MODE is
+//                        entered, from which the TWI slave wakes on address match; within a transaction
+//                        (or while a streaming handler is running) idle, so that data and STOP
+//                        interrupts are served as usual.
+// return: sleep mode entered
+//
+uint8_t i2c_tinyS::sleepUntilActivity_(struct i2cStruct* i2c)
+{
+    uint8_t mode = SLEEP_MODE_IDLE;
+
+    cli(); // no transaction may begin between the check and the sleep
+    if (i2c->startCount < 0 && !(i2c->state & I2C_STATE_HANDLER)) {
+        mode = I2C_SLEEP_MODE;
+        i2c->sleeping = 1;
+    }
+    set_sleep_mode(mode);
+    sleep_enable();
+    sei(); // the instruction after sei is executed before any pending interrupt
+    sleep_cpu();
+    sleep_disable();
+    i2c->sleeping = 0;
+    return mode;
+}
+#endif
+
+
+#if defined(I2C_SNAPSHOT)
+// ------------------------------------------------------------------------------------------------------
+// Set Snapshot - let master reads send from a pair of buffers published in turn
+// parameters:
+//      front = pointer to the buffer published first, or NULL to stop using snapshots
+//      back = pointer to the other buffer
+//      length = size of each buffer
+//      first = first register served from the snapshot (register map mode)
+//
+void i2c_tinyS::setSnapshot_(struct i2cStruct* i2c, void* front, void* back, uint8_t length, uint8_t first)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->snapshot[0] = (uint8_t*)front;
+    i2c->snapshot[1] = (uint8_t*)back;
+    i2c->snapshotLength = (front != (void *)NULL ? length : 0);
+    i2c->snapshotFirst = first;
+    i2c->snapshotFront = 0;
+    i2c->snapshotSending = I2C_SNAPSHOT_NONE;
+    SREG = sreg;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Get Snapshot - returns the back buffer, or NULL while a master read latched before the last
+//                publishSnapshot() is still sending it.  The ISR latches only the front buffer, so
+//                the back buffer stays free once this returns it.
+//
+void* i2c_tinyS::getSnapshot_(struct i2cStruct* i2c)
+{
+    uint8_t back = i2c->snapshotFront ^ 1;
+
+    if (i2c->snapshotSending == back) {
+        return NULL;
+    }
+    return i2c->snapshot[back];
+}
+#endif
+
+
+#if defined(I2C_STATS)
+// ------------------------------------------------------------------------------------------------------
+// Get Statistics - copy the statistics, optionally clearing them
+// parameters:
+//      stats = pointer to store the statistics
+//      clear = true to clear the statistics
+//
+void i2c_tinyS::getStats_(struct i2cStruct* i2c, struct i2cStats* stats, boolean clear)
+{
+    uint8_t sreg = SREG;
+    cli();
+    *stats = i2c->stats;
+    if (clear) {
+        memset(&i2c->stats, 0, sizeof(i2c->stats));
+    }
+    SREG = sreg;
+}
+#endif
+
+
+#if defined(I2C_TRACE_LENGTH)
+// ------------------------------------------------------------------------------------------------------
+// Dump Trace - print the trace, oldest record first, as
+//                  I2CTRACE <number of records>
+//                  <records in hex, 16 per line>
+//                  END
+// parameters:
+//      out = where to print
+//      clear = true to clear the trace
+//
+static void i2c_print_hex(Print& out, uint8_t b)
+{
+    out.write("0123456789ABCDEF"[b >> 4]);
+    out.write("0123456789ABCDEF"[b & 0x0F]);
+}
+
+void i2c_tinyS::dumpTrace_(struct i2cStruct* i2c, Print& out, boolean clear)
+{
+    uint8_t count, index;
+    uint8_t sreg = SREG;
+
+    cli(); // the ISR updates tracePaused and the ring meanwhile
+    i2c->tracePaused |= I2C_TRACE_PAUSED_USER; // the ring stays as it is while printing
+    count = i2c->traceCount;
+    index = i2c->traceHead - count;
+    SREG = sreg;
+    out.print("I2CTRACE ");
+    out.println(count);
+    for (uint8_t n = 0; n < count; n++) {
+        uint8_t* p = &i2c->trace[(index++ & (I2C_TRACE_LENGTH - 1)) * 2];
+        i2c_print_hex(out, p[0]);
+        i2c_print_hex(out, p[1]);
+        if ((n & 15) == 15 || n == count - 1) {
+            out.println();
+        }
+    }
+    out.println("END");
+    sreg = SREG;
+    cli();
+    if (clear) {
+        i2c->traceCount = 0;
+    }
+    i2c->tracePaused &= ~I2C_TRACE_PAUSED_USER;
+    SREG = sreg;
+}
+#endif
+
+
+#if defined(I2C_SMBUS)
+// ------------------------------------------------------------------------------------------------------
+// Set PEC - enable or disable SMBus Packet Error Code
+// parameters:
+//      pec = true to enable PEC
+//
+void i2c_tinyS::setPEC_(struct i2cStruct* i2c, boolean pec)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->smbus = (pec ? I2C_SMBUS_PEC : 0);
+    i2c->pecErrors = 0;
+    SREG = sreg;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Write Block - write byte count followed by data to Tx buffer
+// return: number of data bytes written, 0 if no room for all
+// parameters:
+//      data = pointer to uint8_t array of data
+//      length = number of bytes to write
+//
+size_t i2c_tinyS::writeBlock(const uint8_t* data, uint8_t length)
+{
+    uint8_t sreg = SREG;
+    size_t n = 0;
+    cli(); // count and data go in together
+    if (I2C_TX_BUFFER_LENGTH - (i2c_tx_index_t)(i2c->txBufferLength - i2c->txBufferIndex) > length) {
+        write(length);
+        n = write(data, length);
+    }
+    SREG = sreg;
+    return n;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Read Block - read byte count followed by data from Rx buffer
+// return: byte count sent by master
+// parameters:
+//      data = pointer to uint8_t array to store data
+//      maxLength = size of data array
+//
+uint8_t i2c_tinyS::readBlock_(struct i2cStruct* i2c, uint8_t* data, uint8_t maxLength)
+{
+    uint8_t count = readByte_(i2c);
+    for (uint8_t i = 0; i < count && i2c->rxBufferIndex != i2c->rxBufferLength; i++) {
+        uint8_t b = readByte_(i2c);
+        if (i < maxLength) data[i] = b;
+    }
+    return count;
+}
+
+
+#if defined(I2C_DEFERRED)
+static void i2c_defer_abort(struct i2cStruct* i2c);
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Check Timeout - reset the interface if a transaction has been stuck for I2C_SMBUS_TIMEOUT ms
+// return: true if reset
+//
+boolean i2c_tinyS::checkTimeout_(struct i2cStruct* i2c)
+{
+    uint8_t activity = i2c->activity;
+    unsigned long now = millis();
+
+    if (i2c->startCount < 0 || activity != i2c->timeoutActivity || (i2c->state & I2C_STATE_HANDLER)) {
+        // idle, moving, or held by a running handler
+        i2c->timeoutActivity = activity;
+        i2c->timeoutStart = now;
+        return false;
+    }
+    if (now - i2c->timeoutStart < I2C_SMBUS_TIMEOUT) return false;
+    uint8_t sreg = SREG;
+    cli();
+    TWSCRA = 0; // disabling the interface releases SCL and SDA
+#if defined(I2C_DEFERRED)
+    i2c_defer_abort(i2c);
+#endif
+    i2c->startCount = -1;
+    CLEAR_TENBIT;
+    i2c->state &= ~(I2C_STATE_REGPTR | I2C_STATE_TENBIT);
+    TWSCRA = (_BV(TWSHE) | _BV(TWDIE) | _BV(TWASIE) | _BV(TWEN) | _BV(TWSIE));
+    SREG = sreg;
+    i2c->timeoutStart = now;
+    return true;
+}
+#endif
+
+
+#if defined(I2C_TENBIT_TABLE)
+// ------------------------------------------------------------------------------------------------------
+// Set 10-bit Address - set the table of 10-bit addresses that the ISR ACKs
+// parameters:
+//      address = 10bit slave address (used if list is NULL and count is 1)
+//      list = pointer to array of 10bit slave addresses, or NULL
+//      count = number of addresses in the table, 0 to go back to handling 10-bit addresses by onAddrReceive()
+//      mask = bits ignored in the comparison
+//
+void i2c_tinyS::setTenBitAddress_(struct i2cStruct* i2c, uint16_t address, const uint16_t* list, uint8_t count, uint16_t mask)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->tenbitAddress = address;
+    i2c->tenbitList = (list != NULL ? list : &i2c->tenbitAddress);
+    i2c->tenbitCount = count;
+    i2c->tenbitMask = mask;
+    SREG = sreg;
+}
+#endif
+
+
+#if I2C_DEVICE_TABLE_LENGTH
+// ------------------------------------------------------------------------------------------------------
+// Set Device - serve a virtual device at address
+// return: false if the entry is taken by a device of another address (the table is left unchanged)
+// parameters:
+//      address = 7bit or 10bit slave address; the lowest bits select the entry of device table
+//      device = pointer to the device, or NULL to NACK the address
+//
+boolean i2c_tinyS::setDevice_(struct i2cStruct* i2c, uint16_t address, struct i2cDevice* device)
+{
+    uint8_t n = address & (I2C_DEVICE_TABLE_LENGTH - 1);
+    uint8_t sreg = SREG;
+
+    if (address != 0 && i2c->devices[n] != NULL && i2c->deviceAddr[n] != address) {
+        return false;
+    }
+    cli();
+#if defined(I2C_REGISTER_MAP)
+    if (i2c->device != NULL) {
+        i2c->device->regPointer = i2c->regPointer;
+    }
+#endif
+    i2c->device = (struct i2cDevice*)NULL; // reload the device on next address match
+#if defined(I2C_GENERAL_CALL)
+    if (address == 0) {
+        i2c->generalCall = device; // general call has a device of its own, not a table entry
+    } else
+#endif
+    {
+        i2c->devices[n] = device;
+        i2c->deviceAddr[n] = address;
+    }
+    i2c->state |= I2C_STATE_DEVICES;
+    SREG = sreg;
+    return true;
+}
+#endif
+
+
+#if defined(I2C_DEFERRED)
+// ------------------------------------------------------------------------------------------------------
+// Set Deferred - enter or leave deferred mode; call this while the bus is idle
+// parameters:
+//      deferred = true to enter deferred mode, false to go back to calling handlers from the ISR
+//
+void i2c_tinyS::setDeferred_(struct i2cStruct* i2c, boolean deferred)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c->rxHead = i2c->rxTail = 0;
+    i2c->eventQueueHead = i2c->eventQueueTail = 0;
+    i2c->state &= ~(I2C_STATE_DEFERRED | I2C_STATE_PHASE | I2C_STATE_STAGE);
+    if (deferred) {
+        i2c->state |= (I2C_STATE_DEFERRED | I2C_STATE_STAGE); // stage the first response on first poll()
+    }
+    i2c->txStagedLength = i2c->txBufferLength;
+    SREG = sreg;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Poll - calls the handlers for the transactions queued in deferred mode, then lets onRequest() handler
+//        stage the response to the next master read.  The staging waits until no transaction is in
+//        progress, and TWI interrupts are masked (SCL is stretched if a master starts meanwhile).
+//
+void i2c_tinyS::poll_(struct i2cStruct* i2c)
+{
+    uint8_t sreg = SREG;
+    uint8_t tail;
+
+    while ((tail = i2c->eventQueueTail) != i2c->eventQueueHead) {
+        struct i2cEvent* e = &i2c->eventQueue[tail & (I2C_EVENT_QUEUE_LENGTH - 1)];
+        i2c->polled = e;
+        if (I2C_HAS_ON_ADDR_RECEIVE) {
+            I2C_ON_ADDR_RECEIVE(e->addr, e->startCount); // already ACKed; return value is ignored
+        }
+        if ((e->flags & I2C_EVENT_READ)) {
+            if ((e->flags & I2C_EVENT_STOP) && I2C_HAS_ON_STOP) {
+                I2C_ON_STOP();
+            }
+        } else {
+            i2c->rxBufferIndex = e->start;
+            i2c->rxBufferLength = e->start + e->count;
+            if (I2C_HAS_ON_RECEIVE) {
+                I2C_ON_RECEIVE(e->count);
+            }
+            cli();
+            i2c->rxTail = i2c->rxBufferLength; // release the payload to the ISR
+            SREG = sreg;
+        }
+        i2c->polled = (struct i2cEvent*)NULL;
+        i2c->eventQueueTail = tail + 1;
+        i2c->state |= I2C_STATE_STAGE;
+    }
+    if (!(i2c->state & I2C_STATE_STAGE) || !I2C_HAS_ON_REQUEST) return;
+    cli();
+    if ((i2c->state & I2C_STATE_PHASE)) {
+        SREG = sreg; // a transaction is in progress; try again on next poll()
+        return;
+    }
+    i2c->state &= ~I2C_STATE_STAGE;
+    TWSCRA &= ~(_BV(TWDIE) | _BV(TWASIE) | _BV(TWSIE));
+    SREG = sreg;
+    i2c->txBufferIndex = 0;
+    i2c->txBufferLength = 0;
+#if defined(I2C_TX_SOURCE)
+    i2c->txSourceKind = I2C_SOURCE_NONE;
+#endif
+    I2C_ON_REQUEST();
+    i2c->txStagedLength = i2c->txBufferLength;
+    cli();
+    TWSCRA |= (_BV(TWDIE) | _BV(TWASIE) | _BV(TWSIE));
+    SREG = sreg;
+}
+#endif
+
+
+// ------------------------------------------------------------------------------------------------------
+// Read - returns next data byte (signed int) from Rx buffer
+// return: data, -1 if buffer empty
+//
+int i2c_tinyS::read_(struct i2cStruct* i2c)
+{
+    if(i2c->rxBufferIndex == i2c->rxBufferLength) return -1;
+    return i2c->rxBuffer[i2c->rxBufferIndex++ & I2C_RX_BUFFER_MASK];
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Peek - returns next data byte (signed int) from Rx buffer without removing it from Rx buffer
+// return: data, -1 if buffer empty
+//
+int i2c_tinyS::peek_(struct i2cStruct* i2c)
+{
+    if(i2c->rxBufferIndex == i2c->rxBufferLength) return -1;
+    return i2c->rxBuffer[i2c->rxBufferIndex & I2C_RX_BUFFER_MASK];
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Read Byte - returns next data byte (uint8_t) from Rx buffer
+// return: data, 0 if buffer empty
+//
+uint8_t i2c_tinyS::readByte_(struct i2cStruct* i2c)
+{
+    if(i2c->rxBufferIndex == i2c->rxBufferLength) return 0;
+    return i2c->rxBuffer[i2c->rxBufferIndex++ & I2C_RX_BUFFER_MASK];
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Peek Byte - returns next data byte (uint8_t) from Rx buffer without removing it from Rx buffer
+// return: data, 0 if buffer empty
+//
+uint8_t i2c_tinyS::peekByte_(struct i2cStruct* i2c)
+{
+    if(i2c->rxBufferIndex == i2c->rxBufferLength) return 0;
+    return i2c->rxBuffer[i2c->rxBufferIndex & I2C_RX_BUFFER_MASK];
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Read Array - read up to quantity bytes from Rx buffer; the indices are loaded and stored only once
+// return: number of bytes read
+// parameters:
+//      data = pointer to uint8_t array to store data
+//      quantity = number of bytes to read
+//
+size_t i2c_tinyS::read_(struct i2cStruct* i2c, uint8_t* data, size_t quantity)
+{
+    uint8_t sreg = SREG;
+    cli(); // the ISR may be receiving to Rx buffer meanwhile
+    i2c_rx_index_t index = i2c->rxBufferIndex;
+    i2c_rx_index_t avail = i2c->rxBufferLength - index;
+    SREG = sreg;
+
+    if (quantity > avail) {
+        quantity = avail;
+    }
+    for (size_t count = quantity; count; count--) {
+        *data++ = i2c->rxBuffer[index++ & I2C_RX_BUFFER_MASK];
+    }
+    i2c->rxBufferIndex = index;
+    return quantity;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Read Value - read a multi-byte value from Rx buffer, all or nothing
+// return: true if read, false if Rx buffer has fewer bytes
+// parameters:
+//      value = pointer to store the value (little endian, as AVR is)
+//      size = size of the value
+//      bigEndian = true to read MSB first
+//
+boolean i2c_tinyS::readValue_(struct i2cStruct* i2c, void* value, uint8_t size, boolean bigEndian)
+{
+    uint8_t* p = (uint8_t*)value;
+    uint8_t sreg = SREG;
+    cli();
+    i2c_rx_index_t index = i2c->rxBufferIndex;
+    i2c_rx_index_t avail = i2c->rxBufferLength - index;
+    SREG = sreg;
+
+    if (avail < size) {
+        return false;
+    }
+    if (bigEndian) {
+        p += size;
+        for (uint8_t n = size; n; n--) {
+            *--p = i2c->rxBuffer[index++ & I2C_RX_BUFFER_MASK];
+        }
+    } else {
+        for (uint8_t n = size; n; n--) {
+            *p++ = i2c->rxBuffer[index++ & I2C_RX_BUFFER_MASK];
+        }
+    }
+    i2c->rxBufferIndex = index;
+    return true;
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Get Rx Span - points to the next contiguous bytes in Rx buffer
+// return: number of bytes at *data (up to the end of Rx buffer)
+// parameters:
+//      data = pointer to store the pointer to the bytes
+//
+size_t i2c_tinyS::getRxSpan_(struct i2cStruct* i2c, const uint8_t** data)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c_rx_index_t index = i2c->rxBufferIndex;
+    i2c_rx_index_t avail = i2c->rxBufferLength - index;
+    SREG = sreg;
+
+    size_t offset = index & I2C_RX_BUFFER_MASK;
+    *data = &i2c->rxBuffer[offset];
+    return (avail < I2C_RX_BUFFER_LENGTH - offset ? avail : I2C_RX_BUFFER_LENGTH - offset);
+}
+
+
+// ------------------------------------------------------------------------------------------------------
+// Skip - removes up to quantity bytes from Rx buffer
+// return: number of bytes removed
+//
+size_t i2c_tinyS::skip_(struct i2cStruct* i2c, size_t quantity)
+{
+    uint8_t sreg = SREG;
+    cli();
+    i2c_rx_index_t index = i2c->rxBufferIndex;
+    i2c_rx_index_t avail = i2c->rxBufferLength - index;
+    SREG = sreg;
+
+    if (quantity > avail) {
+        quantity = avail;
+    }
+    i2c->rxBufferIndex = index + quantity;
+    return quantity;
+}
+
+
+// ======================================================================================================
+// ------------------------------------------------------------------------------------------------------
+// I2C Interrupt Service Routine
+// ------------------------------------------------------------------------------------------------------
+// ======================================================================================================
+
+#if defined(I2C_TX_SOURCE)
+// ------------------------------------------------------------------------------------------------------
+// Fetch next byte from Tx source
+//
+static inline uint8_t i2c_source_byte(struct i2cStruct* i2c)
+{
+    const uint8_t* p = i2c->txSource + i2c->txSourceIndex;
+    uint8_t kind = i2c->txSourceKind;
+
+    if (++i2c->txSourceIndex == i2c->txSourceLength) {
+        if ((kind & I2C_SOURCE_WRAP)) {
+            i2c->txSourceIndex = 0;
+        } else {
+            i2c->txSourceKind = I2C_SOURCE_NONE; // source exhausted
+        }
+    }
+    switch (kind & ~I2C_SOURCE_WRAP) {
+    case I2C_SOURCE_PROGMEM:
+        return pgm_read_byte(p);
+#if defined(I2C_SOURCE_EEPROM)
+    case I2C_SOURCE_EEPROM:
+        return eeprom_read_byte(p);
+#endif
+    default:
+        return *p;
+    }
+}
+#endif
+
+#if defined(I2C_REGISTER_MAP)
+// ------------------------------------------------------------------------------------------------------
+// Register file engine - a master write sets register pointer by its first byte and then stores
+//                        the following bytes to the registers through their write masks, while
+//                        a master read sends the registers.  Both advance the pointer and wrap around.
+//
+static inline void i2c_reg_next(struct i2cStruct* i2c)
+{
+    uint8_t p = i2c->regPointer + 1;
+    i2c->regPointer = (p == i2c->regSize ? 0 : p);
+}
+
+static inline void i2c_reg_write(struct i2cStruct* i2c, uint8_t data)
+{
+    if ((i2c->state & I2C_STATE_REGPTR)) {
+        i2c->state &= ~I2C_STATE_REGPTR;
+        while (data >= i2c->regSize) {
+            data -= i2c->regSize;
+        }
+        i2c->regPointer = data;
+        i2c->regFirst = data;
+        i2c->regCount = 0;
+        return;
+    }
+    uint8_t p = i2c->regPointer;
+    uint8_t mask = (i2c->regMask != (void *)NULL ? i2c->regMask[p] : 0xFF);
+    i2c->regs[p] = ((i2c->regs[p] & ~mask) | (data & mask));
+    if (i2c->regCount < i2c->regSize) {
+        i2c->regCount++;
+    }
+    i2c_reg_next(i2c);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Queue the registers written by the last master write for getRegisterWrite()
 //
-i2c_tinyS::i2c_tinyS()
+static void i2c_reg_commit(struct i2cStruct* i2c)
 {
-    i2c = &i2cData;
+    i2c->state &= ~I2C_STATE_REGPTR;
+    if (i2c->regCount) {
+#if I2C_REG_QUEUE_LENGTH
+        uint8_t head = i2c->regQueueHead;
+        if ((uint8_t)(head - i2c->regQueueTail) < I2C_REG_QUEUE_LENGTH) {
+            i2c->regQueue[head & (I2C_REG_QUEUE_LENGTH - 1)].first = i2c->regFirst;
+            i2c->regQueue[head & (I2C_REG_QUEUE_LENGTH - 1)].count = i2c->regCount;
+            i2c->regQueueHead = head + 1;
+        }
+#endif
+        i2c->regCount = 0;
+    }
 }
+#endif
 
-i2c_tinyS::~i2c_tinyS()
+#if defined(I2C_TX_STREAMING) || defined(I2C_RX_STREAMING)
+// ------------------------------------------------------------------------------------------------------
+// Streaming handlers - onRequestMore() and onReceiveChunk() handlers are called with the bus released
+//                      and interrupts enabled so that the other half of the buffer keeps being sent or
+//                      received while the handler runs.  SCL is held only if the ISR runs out of data
+//                      or space before the handler returns.  Address and stop events are held off;
+//                      TWSIE stays set so that a STOP meanwhile still raises TWASIF for after the handler.
+//
+static void i2c_release(struct i2cStruct* i2c)
 {
+    i2c->state |= I2C_STATE_HANDLER;
+    TWSCRA &= ~_BV(TWASIE);
+    sei();
 }
 
+static void i2c_resume(struct i2cStruct* i2c)
+{
+    cli();
+    i2c->state &= ~I2C_STATE_HANDLER;
+    TWSCRA |= (_BV(TWDIE) | _BV(TWASIE) | _BV(TWSIE)); // resume if the ISR held SCL
+}
+#endif
 
+#if defined(I2C_TX_STREAMING)
 // ------------------------------------------------------------------------------------------------------
-// Initialize I2C - initializes I2C as two address or address range Slave
-// return: none
-// parameters:
-//      address = 7bit address for specifying 1st Slave address
-//      mask = 8bit integer;
-//             if bit[0]==1 then bit[7:1] 2nd Slave address
-//             if bit[0]==0 then bit[7:1] mask bits for address
+// Refill Tx buffer
 //
-void i2c_tinyS::begin_(struct i2cStruct* i2c, uint8_t address, uint8_t mask)
+static void i2c_refill(struct i2cStruct* i2c)
 {
-    I2C_INTR_FLAG_INIT; // init I2C interrupt flag if used
-    TWSA = (address << 1);
-    TWSAM = mask; // if mask == 0 then only one address
-    i2c->startCount = -1;
-    TWSCRA = (_BV(TWSHE) | _BV(TWDIE) | _BV(TWASIE) | _BV(TWEN) | _BV(TWSIE));
+    i2c_release(i2c);
+    I2C_ON_REQUEST_MORE();
+    i2c_resume(i2c);
 }
+#endif
 
-
+#if defined(I2C_RX_STREAMING)
 // ------------------------------------------------------------------------------------------------------
-// Write - write data to Tx buffer
-// return: 1=success, 0=fail
-// parameters:
-//      data = data byte
+// Deliver full Rx chunks
 //
-size_t i2c_tinyS::write(uint8_t data)
+static void i2c_deliver(struct i2cStruct* i2c)
 {
-    if(i2c->txBufferLength < I2C_BUFFER_LENGTH)
-    {
-        i2c->Buffer[i2c->txBufferLength++] = data;
-        return 1;
+    i2c_release(i2c);
+    for (;;) {
+        I2C_ON_RECEIVE_CHUNK(i2c->rxBuffer + (i2c->rxBufferIndex & I2C_RX_BUFFER_MASK), I2C_RX_CHUNK_LENGTH);
+        cli();
+        i2c->rxBufferIndex += I2C_RX_CHUNK_LENGTH;
+        if ((i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex) < I2C_RX_CHUNK_LENGTH) {
+            break; // interrupts stay disabled until i2c_resume(), so no byte slips in unchecked
+        }
+        sei();
     }
-    return 0;
+    i2c_resume(i2c);
 }
 
+// ------------------------------------------------------------------------------------------------------
+// Deliver the rest of Rx buffer at the end of a master write - in contiguous spans of at most a chunk
+//
+static void i2c_deliver_rest(struct i2cStruct* i2c)
+{
+    i2c_rx_index_t n;
+
+    while ((n = i2c->rxBufferLength - i2c->rxBufferIndex)) {
+        i2c_rx_index_t offset = i2c->rxBufferIndex & I2C_RX_BUFFER_MASK;
+        if (n > I2C_RX_BUFFER_LENGTH - offset) {
+            n = I2C_RX_BUFFER_LENGTH - offset; // up to the end of the ring
+        }
+        if (n > I2C_RX_CHUNK_LENGTH) {
+            n = I2C_RX_CHUNK_LENGTH;
+        }
+        I2C_ON_RECEIVE_CHUNK(i2c->rxBuffer + offset, n);
+        i2c->rxBufferIndex += n;
+    }
+}
+#endif
 
+#if I2C_DEVICE_TABLE_LENGTH
 // ------------------------------------------------------------------------------------------------------
-// Write Array - write length number of bytes from data array to Tx buffer
-// parameters:
-//      data = pointer to uint8_t array of data
-//      length = number of bytes to write
+// Select the virtual device of the matched address - loads its handlers and register map only when
+//                                                    the device differs from the last one
+// return: false if no device is set at the address
 //
-size_t i2c_tinyS::write(const uint8_t* data, size_t quantity)
+static boolean i2c_select_device(struct i2cStruct* i2c)
 {
-    if(i2c->txBufferLength < I2C_BUFFER_LENGTH)
-    {
-        size_t avail = I2C_BUFFER_LENGTH - i2c->txBufferLength;
-        uint8_t* dest = i2c->Buffer + i2c->txBufferLength;
+    uint16_t address = ((i2c->state & I2C_STATE_TENBIT) ? i2c->Addr : i2c->Addr >> 1);
+    uint8_t n = address & (I2C_DEVICE_TABLE_LENGTH - 1);
+    struct i2cDevice* d;
 
-        if(quantity > avail)
-        {
-            quantity = avail; // truncate to space avail if needed
+#if defined(I2C_GENERAL_CALL)
+    if ((i2c->state & I2C_STATE_GENERAL)) {
+        d = i2c->generalCall;
+    } else
+#endif
+    {
+        d = (i2c->deviceAddr[n] == address ? i2c->devices[n] : (struct i2cDevice*)NULL); // another address may share the entry
+    }
+    if (d == NULL) return false;
+    if (d != i2c->device) {
+#if defined(I2C_REGISTER_MAP)
+        if (i2c->device != NULL) {
+            i2c->device->regPointer = i2c->regPointer;
         }
-        for(size_t count=quantity; count; count--)
-            *dest++ = *data++;
-        i2c->txBufferLength += quantity;
+        i2c->regs = (d->regSize ? d->regs : (volatile uint8_t*)NULL);
+        i2c->regMask = d->regMask;
+        i2c->regSize = d->regSize;
+        i2c->regPointer = d->regPointer;
+#endif
+#if !defined(I2C_STATIC_ON_ADDR_RECEIVE)
+        i2c->user_onAddrReceive = d->onAddrReceive;
+#endif
+#if !defined(I2C_STATIC_ON_RECEIVE)
+        i2c->user_onReceive = d->onReceive;
+#endif
+#if defined(I2C_RX_STREAMING) && !defined(I2C_STATIC_ON_RECEIVE_CHUNK)
+        i2c->user_onReceiveChunk = d->onReceiveChunk;
+#endif
+#if !defined(I2C_STATIC_ON_REQUEST)
+        i2c->user_onRequest = d->onRequest;
+#endif
+#if defined(I2C_TX_STREAMING) && !defined(I2C_STATIC_ON_REQUEST_MORE)
+        i2c->user_onRequestMore = d->onRequestMore;
+#endif
+#if !defined(I2C_STATIC_ON_STOP)
+        i2c->user_onStop = d->onStop;
+#endif
+        i2c->device = d;
     }
+    return true;
+}
+#endif
+
+#if defined(I2C_SMBUS)
+// ------------------------------------------------------------------------------------------------------
+// PEC - CRC-8 (x^8 + x^2 + x + 1) updated one byte at a time as it is shifted in or out
+//
+#if I2C_SMBUS_PEC_TABLE == 256
+static const uint8_t i2c_crc8_table[256] PROGMEM = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+    0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+    0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+    0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+    0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+    0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+    0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+    0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+    0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+    0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3,
+};
+
+static inline uint8_t i2c_crc8(uint8_t crc, uint8_t data)
+{
+    return pgm_read_byte(&i2c_crc8_table[crc ^ data]);
 }
+#else
+static const uint8_t i2c_crc8_table[16] PROGMEM = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+};
 
+static inline uint8_t i2c_crc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    crc = (crc << 4) ^ pgm_read_byte(&i2c_crc8_table[crc >> 4]);
+    return (crc << 4) ^ pgm_read_byte(&i2c_crc8_table[crc >> 4]);
+}
+#endif
+#endif
 
+#if defined(I2C_TRACE_LENGTH)
 // ------------------------------------------------------------------------------------------------------
-// Read - returns next data byte (signed int) from Rx buffer
-// return: data, -1 if buffer empty
+// Record a bus event in the trace ring
 //
-int i2c_tinyS::read_(struct i2cStruct* i2c)
+static inline void i2c_trace(struct i2cStruct* i2c, uint8_t type, uint8_t value)
 {
-    if(i2c->rxBufferIndex >= i2c->rxBufferLength) return -1;
-    return i2c->Buffer[i2c->rxBufferIndex++];
+    if (i2c->tracePaused) return;
+    uint8_t now = (uint8_t)(I2C_TRACE_TIMER);
+    uint8_t ticks = now - i2c->traceTime;
+    uint8_t* p = &i2c->trace[(i2c->traceHead++ & (I2C_TRACE_LENGTH - 1)) * 2];
+
+    i2c->traceTime = now;
+    p[0] = type | (ticks > I2C_TRACE_TICKS ? I2C_TRACE_TICKS : ticks);
+    p[1] = value;
+    if (i2c->traceCount < I2C_TRACE_LENGTH) {
+        i2c->traceCount++;
+    }
 }
+#endif
 
+// ------------------------------------------------------------------------------------------------------
+// Send a data byte to master
+//
+static inline void i2c_send(struct i2cStruct* i2c, uint8_t data)
+{
+    I2C_STAT(txBytes);
+    I2C_TRACE(I2C_TRACE_TX, data);
+#if defined(I2C_SMBUS)
+    if ((i2c->smbus & I2C_SMBUS_PEC)) {
+        i2c->pec = i2c_crc8(i2c->pec, data);
+    }
+#endif
+    TWSD = data;
+}
 
+#if defined(I2C_TRACE_REGISTER)
 // ------------------------------------------------------------------------------------------------------
-// Peek - returns next data byte (signed int) from Rx buffer without removing it from Rx buffer
-// return: data, -1 if buffer empty
+// Send the trace - the number of records from Tx buffer, then the ring from its oldest record as Tx source
 //
-int i2c_tinyS::peek_(struct i2cStruct* i2c)
+static void i2c_trace_load(struct i2cStruct* i2c)
 {
-    if(i2c->rxBufferIndex >= i2c->rxBufferLength) return -1;
-    return i2c->Buffer[i2c->rxBufferIndex];
+    i2c->tracePaused |= I2C_TRACE_PAUSED_BUS;
+    i2c->txBuffer[0] = i2c->traceCount;
+    i2c->txBufferLength = 1;
+    i2c->txSource = i2c->trace;
+    i2c->txSourceLength = sizeof(i2c->trace);
+    i2c->txSourceIndex = ((i2c->traceHead - i2c->traceCount) & (I2C_TRACE_LENGTH - 1)) * 2;
+    i2c->txSourceKind = (I2C_SOURCE_RAM | I2C_SOURCE_WRAP);
 }
+#endif
+
+#if defined(I2C_STATS_REGISTER)
+// ------------------------------------------------------------------------------------------------------
+// Load a snapshot of the statistics to Tx buffer (truncated to its size)
+//
+static void i2c_stats_load(struct i2cStruct* i2c)
+{
+    const uint8_t* p = (const uint8_t*)&i2c->stats;
+    uint8_t n;
 
+    for (n = 0; n < sizeof(struct i2cStats) && n < I2C_TX_BUFFER_LENGTH; n++) {
+        i2c->txBuffer[n] = *p++;
+    }
+    i2c->txBufferLength = n;
+}
+#endif
 
+#if defined(I2C_GENERAL_CALL)
 // ------------------------------------------------------------------------------------------------------
-// Read Byte - returns next data byte (uint8_t) from Rx buffer
-// return: data, 0 if buffer empty
+// General call reset - drop the pending response and rewind the register pointers
 //
-uint8_t i2c_tinyS::readByte_(struct i2cStruct* i2c)
+static void i2c_general_reset(struct i2cStruct* i2c)
 {
-    if(i2c->rxBufferIndex >= i2c->rxBufferLength) return 0;
-    return i2c->Buffer[i2c->rxBufferIndex++];
+    i2c->txBufferIndex = 0;
+    i2c->txBufferLength = 0;
+#if defined(I2C_DEFERRED)
+    i2c->txStagedLength = 0;
+#endif
+#if defined(I2C_TX_SOURCE)
+    i2c->txSourceKind = I2C_SOURCE_NONE;
+#endif
+#if defined(I2C_REGISTER_MAP)
+    i2c->regPointer = 0;
+#if I2C_DEVICE_TABLE_LENGTH
+    for (uint8_t n = 0; n < I2C_DEVICE_TABLE_LENGTH; n++) {
+        if (i2c->devices[n] != NULL) {
+            i2c->devices[n]->regPointer = 0;
+        }
+    }
+    if (i2c->generalCall != NULL) {
+        i2c->generalCall->regPointer = 0;
+    }
+#endif
+#endif
 }
+#endif
 
+#if defined(I2C_TENBIT_TABLE)
+// ------------------------------------------------------------------------------------------------------
+// Match 10-bit address against the table
+// return: true if any address of the table agrees in the bits given (except masked ones)
+//
+static boolean i2c_tenbit_match(struct i2cStruct* i2c, uint16_t address, uint16_t bits)
+{
+    bits &= ~i2c->tenbitMask;
+    for (uint8_t i = 0; i < i2c->tenbitCount; i++) {
+        if (!((i2c->tenbitList[i] ^ address) & bits)) return true;
+    }
+    return false;
+}
+#endif
 
+#if defined(I2C_DEFERRED)
 // ------------------------------------------------------------------------------------------------------
-// Peek Byte - returns next data byte (uint8_t) from Rx buffer without removing it from Rx buffer
-// return: data, 0 if buffer empty
+// Deferred mode - close the open transaction record and queue it for poll()
 //
-uint8_t i2c_tinyS::peekByte_(struct i2cStruct* i2c)
+static void i2c_defer_end(struct i2cStruct* i2c, uint8_t flags)
 {
-    if(i2c->rxBufferIndex >= i2c->rxBufferLength) return 0;
-    return i2c->Buffer[i2c->rxBufferIndex];
+    if (!(i2c->state & I2C_STATE_PHASE)) return;
+    i2c->state &= ~I2C_STATE_PHASE;
+    uint8_t head = i2c->eventQueueHead;
+    struct i2cEvent* e = &i2c->eventQueue[head & (I2C_EVENT_QUEUE_LENGTH - 1)];
+    e->flags |= flags;
+    if ((e->flags & I2C_EVENT_READ)) {
+        e->count = i2c->txBufferIndex;
+        i2c->txBufferIndex = 0; // next read sends the staged response from its beginning,
+        i2c->txBufferLength = i2c->txStagedLength; // not the bytes the Tx source appended
+    } else {
+        e->count = (i2c_rx_index_t)(i2c->rxHead - e->start);
+    }
+    i2c->eventQueueHead = head + 1;
 }
 
+// ------------------------------------------------------------------------------------------------------
+// Deferred mode - open a transaction record at address match
+// return: false if the queue is full
+//
+static boolean i2c_defer_begin(struct i2cStruct* i2c, uint8_t status)
+{
+    i2c_defer_end(i2c, 0); // a transaction ended by repeated START
+    uint8_t head = i2c->eventQueueHead;
+    if ((uint8_t)(head - i2c->eventQueueTail) >= I2C_EVENT_QUEUE_LENGTH) return false;
+    struct i2cEvent* e = &i2c->eventQueue[head & (I2C_EVENT_QUEUE_LENGTH - 1)];
+    e->addr = i2c->Addr;
+    e->startCount = i2c->startCount;
+    if ((status & _BV(TWDIR))) {
+        e->flags = I2C_EVENT_READ;
+    } else {
+        e->flags = 0;
+        e->start = i2c->rxHead;
+    }
+    i2c->state |= I2C_STATE_PHASE;
+    return true;
+}
 
-// ======================================================================================================
 // ------------------------------------------------------------------------------------------------------
-// I2C Interrupt Service Routine
+// Deferred mode - drop the open transaction record on bus error
+//
+static void i2c_defer_abort(struct i2cStruct* i2c)
+{
+    if ((i2c->state & I2C_STATE_PHASE)) {
+        struct i2cEvent* e = &i2c->eventQueue[i2c->eventQueueHead & (I2C_EVENT_QUEUE_LENGTH - 1)];
+        if ((e->flags & I2C_EVENT_READ)) {
+            i2c->txBufferIndex = 0;
+            i2c->txBufferLength = i2c->txStagedLength;
+        } else {
+            i2c->rxHead = e->start;
+        }
+        i2c->state &= ~I2C_STATE_PHASE;
+    }
+}
+#endif
+
+#if defined(I2C_FAST_PATH)
 // ------------------------------------------------------------------------------------------------------
-// ======================================================================================================
+// Fast path check - called on address match; the data bytes of the transaction may take the fast path
+//                   if they only move between TWSD and the Tx/Rx buffer
+//
+static inline uint8_t i2c_fast_ok(struct i2cStruct* i2c)
+{
+#if defined(I2C_REGISTER_MAP)
+    if (i2c->regs != (void *)NULL) return 0;
+#endif
+#if defined(I2C_TX_STREAMING)
+    if (I2C_HAS_ON_REQUEST_MORE) return 0;
+#endif
+#if defined(I2C_RX_STREAMING)
+    if (I2C_HAS_ON_RECEIVE_CHUNK) return 0;
+#endif
+#if defined(I2C_SMBUS)
+    if ((i2c->smbus & I2C_SMBUS_PEC)) return 0;
+#endif
+#if defined(I2C_GENERAL_CALL)
+    if ((i2c->state & I2C_STATE_GENERAL)) return 0;
+#endif
+    return 1;
+}
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// NACK an address - undoes the address match, so that the STOP of the transaction is taken as another
+//                   slave's and the Rx buffer is left as it was
+//
+static void i2c_nack_address(struct i2cStruct* i2c, byte status, i2c_rx_index_t rxIndex)
+{
+    I2C_STAT(nacks);
+    I2C_TRACE(I2C_TRACE_NACK, status);
+    i2c->rxBufferIndex = rxIndex;
+    i2c->startCount = -1;
+    CLEAR_TENBIT;
+    i2c->state &= ~I2C_STATE_TENBIT;
+    TWSCRB = (B0111 | TWI_HIGH_NOISE_MODE); // Send NACK
+}
 
 void i2c_isr_handler()
 {
     struct i2cStruct *i2c = &(i2c_tinyS::i2cData);
     byte status = TWSSRA;
+#if defined(I2C_FAST_PATH)
+    i2c->fast = 0; // set again only at the end of an address match
+#endif
+#if defined(I2C_SMBUS)
+    i2c->activity++;
+#endif
+    I2C_STAT(interrupts);
     if ((status & (_BV(TWC) | _BV(TWBE)))) {
         // Bus error or transmit collision
+#if defined(I2C_STATS)
+        if ((status & _BV(TWBE))) {
+            I2C_STAT(busErrors);
+        } else {
+            I2C_STAT(collisions);
+        }
+#endif
+        I2C_TRACE(I2C_TRACE_ERROR, status);
+#if defined(I2C_DEFERRED)
+        i2c_defer_abort(i2c);
+#endif
+#if defined(I2C_SNAPSHOT)
+        i2c->snapshotSending = I2C_SNAPSHOT_NONE;
+#endif
         i2c->startCount = -1;
         CLEAR_TENBIT;
+        i2c->state &= ~I2C_STATE_TENBIT;
         TWSSRA |= (_BV(TWASIF) | _BV(TWDIF) | _BV(TWBE)); // Release hold
         return;
     }
     if ((status & _BV(TWASIF)) || IS_TENBIT) {
         if ((status & _BV(TWAS))) {
             // A valid address has been received
+            i2c_rx_index_t rxIndex = i2c->rxBufferIndex; // restored if the address is NACKed
+#if defined(I2C_TRACE_LENGTH)
+            if (IS_TENBIT) {
+                I2C_TRACE(I2C_TRACE_RX, TWSD);
+            } else {
+                I2C_TRACE((i2c->startCount < 0 ? I2C_TRACE_START : I2C_TRACE_RESTART), TWSD);
+                i2c->tracePaused &= ~I2C_TRACE_PAUSED_BUS;
+            }
+#endif
             if (IS_TENBIT) {
                 i2c->Addr = (((i2c->Addr & B110) << 7) | TWSD);
                 // CLEAR_TENBIT;
-            } else {
+#if defined(I2C_TENBIT_TABLE)
+                if (i2c->tenbitCount && !i2c_tenbit_match(i2c, i2c->Addr, 0x3FF)) {
+                    i2c_nack_address(i2c, status, rxIndex); // another 10-bit device is addressed
+                    return;
+                }
+#endif
+                i2c->state |= I2C_STATE_TENBIT;
+            } else
+#if defined(I2C_TENBIT_TABLE)
+            if (i2c->tenbitCount && (TWSD & B11111001) == B11110001) {
+                // 10-bit read header after repeated START; only for the 10-bit device addressed before it
+                if (!(i2c->state & I2C_STATE_TENBIT) || (((i2c->Addr >> 7) ^ TWSD) & B110)) {
+                    i2c_nack_address(i2c, status, rxIndex);
+                    return;
+                }
+                i2c->startCount++; // i2c->Addr keeps the 10-bit address
+            } else
+#endif
+            {
                 i2c->Addr = TWSD;
                 i2c->startCount++;
+                i2c->state &= ~(I2C_STATE_TENBIT | I2C_STATE_GENERAL);
+#if defined(I2C_GENERAL_CALL)
+                if (i2c->Addr == 0) {
+                    i2c->state |= I2C_STATE_GENERAL; // general call write
+                }
+#endif
                 if ((i2c->Addr & B11111001) == B11110000) {
+#if defined(I2C_TENBIT_TABLE)
+                    if (i2c->tenbitCount && !i2c_tenbit_match(i2c, (i2c->Addr & B110) << 7, 0x300)) {
+                        i2c_nack_address(i2c, status, rxIndex); // no 10-bit address of ours has this header
+                        return;
+                    }
+#endif
                     SET_TENBIT;
                     TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE); // Send ACK
                     return;
                 }
             }
-            if (i2c->user_onAddrReceive != (void *)NULL) {
+#if defined(I2C_STATS)
+            if (i2c->startCount) {
+                I2C_STAT(repeatedStarts);
+            } else {
+                I2C_STAT(transactions);
+            }
+#endif
+#if defined(I2C_SMBUS)
+            if ((i2c->smbus & I2C_SMBUS_PEC)) {
+                // PEC covers the address bytes too, and runs over a repeated START
+                i2c->pec = i2c_crc8((i2c->startCount ? i2c->pec : 0), TWSD);
+                i2c->smbus &= ~I2C_SMBUS_PEC_SENT;
+            }
+#endif
+#if defined(I2C_DEFERRED)
+            if ((i2c->state & I2C_STATE_DEFERRED)) {
+                if (!i2c_defer_begin(i2c, status)) {
+                    i2c_nack_address(i2c, status, rxIndex); // poll() is behind
+                    return;
+                }
+                TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE); // Send ACK
+                return;
+            }
+#endif
+#if defined(I2C_REGISTER_MAP)
+            if (i2c->regs != (void *)NULL) {
+                i2c_reg_commit(i2c); // a master write ended by repeated START
+            } else
+#endif
+#if defined(I2C_RX_STREAMING)
+            if (I2C_HAS_ON_RECEIVE_CHUNK) {
+                i2c_deliver_rest(i2c); // a master write ended by repeated START
+            } else
+#endif
+            {
                 i2c->rxBufferIndex = 0;
-                if (!i2c->user_onAddrReceive(i2c->Addr, i2c->startCount)) {
-                    TWSCRB = (B0111 | TWI_HIGH_NOISE_MODE); // Send NACK
+            }
+#if I2C_DEVICE_TABLE_LENGTH
+            if ((i2c->state & I2C_STATE_DEVICES) && !i2c_select_device(i2c)) {
+                i2c_nack_address(i2c, status, rxIndex); // no device at this address
+                return;
+            }
+#endif
+            if (I2C_HAS_ON_ADDR_RECEIVE) {
+                if (!I2C_ON_ADDR_RECEIVE(i2c->Addr, i2c->startCount)) {
+                    i2c_nack_address(i2c, status, rxIndex);
                     return;
                 }
             }
+#if defined(I2C_SNAPSHOT)
+            i2c->snapshotSending = ((status & _BV(TWDIR)) && i2c->snapshotLength ? i2c->snapshotFront : I2C_SNAPSHOT_NONE);
+#endif
+#if defined(I2C_REGISTER_MAP)
+            if (i2c->regs != (void *)NULL) {
+                // Register file mode; the ISR handles the data bytes by itself
+                i2c->txBufferIndex = 0;
+                if (!(status & _BV(TWDIR))) {
+                    i2c->state |= I2C_STATE_REGPTR; // the first byte written is register pointer
+                }
+            } else
+#endif
             if ((status & _BV(TWDIR))) {
                 // A master read operation is in progress
+                i2c->txBufferIndex = 0;
                 i2c->txBufferLength = 0;
-                if (i2c->user_onRequest != (void *)NULL) {
-                    i2c->user_onRequest(); // load Tx buffer with data
+#if defined(I2C_TX_SOURCE)
+                i2c->txSourceKind = I2C_SOURCE_NONE;
+#endif
+#if defined(I2C_STATS_REGISTER)
+                if (i2c->startCount && i2c->rxBufferLength == 1 && i2c->rxBuffer[0] == I2C_STATS_REGISTER) {
+                    i2c_stats_load(i2c); // statistics register
+                } else
+#endif
+#if defined(I2C_TRACE_REGISTER)
+                if (i2c->startCount && i2c->rxBufferLength == 1 && i2c->rxBuffer[0] == I2C_TRACE_REGISTER) {
+                    i2c_trace_load(i2c); // trace register
+                } else
+#endif
+#if defined(I2C_SNAPSHOT) && defined(I2C_TX_SOURCE)
+                if (i2c->snapshotSending != I2C_SNAPSHOT_NONE) {
+                    // send the snapshot latched above
+                    i2c->txSource = i2c->snapshot[i2c->snapshotSending];
+                    i2c->txSourceLength = i2c->snapshotLength;
+                    i2c->txSourceIndex = 0;
+                    i2c->txSourceKind = I2C_SOURCE_RAM;
+                } else
+#endif
+                if (I2C_HAS_ON_REQUEST) {
+                    I2C_ON_REQUEST(); // load Tx buffer with data
                 }
-                i2c->txBufferIndex = 0;
             } else {
                 // A master write operation is in progress
+                i2c->rxBufferIndex = 0;
                 i2c->rxBufferLength = 0;
             }
+#if defined(I2C_FAST_PATH)
+            i2c->fast = i2c_fast_ok(i2c);
+#endif
+        } else if (i2c->startCount < 0) {
+            // STOP of a transaction addressed to another slave; TWSIE reports every STOP on the bus
+            TWSSRA = _BV(TWASIF); // clear interrupt
+            return;
         } else {
             // Stop condition is detected
+            I2C_TRACE(I2C_TRACE_STOP, 0);
+#if defined(I2C_SNAPSHOT)
+            i2c->snapshotSending = I2C_SNAPSHOT_NONE;
+#endif
+#if defined(I2C_TRACE_LENGTH)
+            i2c->tracePaused &= ~I2C_TRACE_PAUSED_BUS;
+#endif
+#if defined(I2C_DEFERRED)
+            if ((i2c->state & I2C_STATE_DEFERRED)) {
+                i2c_defer_end(i2c, I2C_EVENT_STOP);
+            } else
+#endif
             if ((status & _BV(TWDIR))) {
-                if (i2c->user_onStop != (void *)NULL) {
-                    i2c->user_onStop();
+                if (I2C_HAS_ON_STOP) {
+                    I2C_ON_STOP();
                 }
-            } else {
-                if (i2c->user_onReceive != (void *)NULL) {
+            } else
+#if defined(I2C_REGISTER_MAP)
+            if (i2c->regs != (void *)NULL) {
+                i2c_reg_commit(i2c);
+            } else
+#endif
+            {
+#if defined(I2C_RX_STREAMING)
+                if (I2C_HAS_ON_RECEIVE_CHUNK) {
+                    i2c_deliver_rest(i2c); // nothing is left for read()
+                } else
+#endif
+                {
                     i2c->rxBufferIndex = 0;
-                    i2c->user_onReceive(i2c->rxBufferLength);
+                }
+#if defined(I2C_SMBUS)
+                if ((i2c->smbus & I2C_SMBUS_PEC) && i2c->rxBufferIndex != i2c->rxBufferLength) {
+                    // the last byte is PEC, with which the CRC of the whole message comes to 0
+                    i2c->rxBufferLength--;
+                    if (i2c->pec) {
+                        i2c->pecErrors++;
+                        i2c->rxBufferLength = i2c->rxBufferIndex; // discard the message
+                    } else if (I2C_HAS_ON_RECEIVE) {
+                        I2C_ON_RECEIVE((i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex));
+                    }
+                } else
+#endif
+                if (I2C_HAS_ON_RECEIVE) {
+                    // the bytes left for read(); none if they have been passed to onReceiveChunk()
+                    I2C_ON_RECEIVE((i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex));
                 }
             }
             i2c->startCount = -1;
             CLEAR_TENBIT;
+            i2c->state &= ~I2C_STATE_TENBIT;
             TWSSRA = _BV(TWASIF); // clear interrupt
             return;
         }
     } else if ((status & _BV(TWDIF))) {
         if ((status & _BV(TWDIR))) {
             // Send a data byte to master
-            if (i2c->txBufferIndex < i2c->txBufferLength) {
-                TWSD = i2c->Buffer[i2c->txBufferIndex++];
-            } else {
-                // buffer overrun
-                TWSCRB = (B0010 | TWI_HIGH_NOISE_MODE); // Wait for any START condition
-                return;
+#if defined(I2C_REGISTER_MAP)
+            if (i2c->regs != (void *)NULL) {
+#if defined(I2C_SNAPSHOT)
+                uint8_t n = i2c->regPointer - i2c->snapshotFirst;
+                if (i2c->snapshotSending != I2C_SNAPSHOT_NONE && n < i2c->snapshotLength) {
+                    i2c_send(i2c, i2c->snapshot[i2c->snapshotSending][n]);
+                } else
+#endif
+                i2c_send(i2c, i2c->regs[i2c->regPointer]);
+                i2c_reg_next(i2c);
+                i2c->txBufferIndex++;
+            } else
+#endif
+            {
+                if (i2c->txBufferIndex == i2c->txBufferLength && !TX_SOURCE_ACTIVE) {
+#if defined(I2C_TX_STREAMING)
+                    if ((i2c->state & I2C_STATE_HANDLER)) {
+                        // onRequestMore() handler is still running; hold SCL until it returns
+                        TWSCRA &= ~_BV(TWDIE);
+                        return;
+                    }
+                    if (I2C_HAS_ON_REQUEST_MORE) {
+                        I2C_ON_REQUEST_MORE(); // buffer ran dry; refill while SCL is held
+                    }
+                    if (i2c->txBufferIndex == i2c->txBufferLength && !TX_SOURCE_ACTIVE)
+#endif
+                    {
+#if defined(I2C_SMBUS)
+                        if ((i2c->smbus & (I2C_SMBUS_PEC | I2C_SMBUS_PEC_SENT)) == I2C_SMBUS_PEC) {
+                            // the response is complete; append PEC
+                            i2c->smbus |= I2C_SMBUS_PEC_SENT;
+                            I2C_TRACE(I2C_TRACE_TX, i2c->pec);
+                            TWSD = i2c->pec;
+                            TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
+                            return;
+                        }
+#endif
+                        // buffer underrun
+                        I2C_STAT(underruns);
+                        I2C_TRACE(I2C_TRACE_UNDERRUN, 0);
+                        TWSCRB = (B0010 | TWI_HIGH_NOISE_MODE); // Wait for any START condition
+                        return;
+                    }
+                }
+#if defined(I2C_TX_SOURCE)
+                if (i2c->txBufferIndex == i2c->txBufferLength) {
+                    // Tx buffer is empty; take the byte straight from Tx source
+                    i2c_send(i2c, i2c_source_byte(i2c));
+                    i2c->txBufferIndex++;
+                    i2c->txBufferLength++;
+                } else
+#endif
+                {
+                    i2c_send(i2c, i2c->txBuffer[i2c->txBufferIndex++ & I2C_TX_BUFFER_MASK]);
+                }
+#if defined(I2C_TX_STREAMING)
+                if (I2C_HAS_ON_REQUEST_MORE && !(i2c->state & I2C_STATE_HANDLER) && !TX_SOURCE_ACTIVE
+                    && (i2c_tx_index_t)(i2c->txBufferLength - i2c->txBufferIndex) <= I2C_TX_REFILL_LEVEL) {
+                    TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
+                    i2c_refill(i2c);
+                    return;
+                }
+#endif
             }
         } else {
             // A data byte has been received
-            if (i2c->rxBufferLength < I2C_BUFFER_LENGTH) {
-                i2c->Buffer[i2c->rxBufferLength++] = TWSD;
+            I2C_STAT(rxBytes);
+            I2C_TRACE(I2C_TRACE_RX, TWSD);
+#if defined(I2C_SMBUS)
+            if ((i2c->smbus & I2C_SMBUS_PEC)) {
+                i2c->pec = i2c_crc8(i2c->pec, TWSD);
+            }
+#endif
+#if defined(I2C_GENERAL_CALL)
+            if ((i2c->state & I2C_STATE_GENERAL)) {
+                // the first byte of a general call write; take the commands here
+                uint8_t command = TWSD;
+                i2c->state &= ~I2C_STATE_GENERAL;
+                if (command == I2C_GENERAL_CALL_RESET || command == I2C_GENERAL_CALL_SYNC) {
+                    if (command == I2C_GENERAL_CALL_RESET) {
+                        i2c_general_reset(i2c);
+                    }
+                    if (I2C_HAS_ON_GENERAL_CALL) {
+                        I2C_ON_GENERAL_CALL(command);
+                    }
+                    TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
+                    return;
+                }
+            }
+#endif
+#if defined(I2C_REGISTER_MAP)
+            if (i2c->regs != (void *)NULL) {
+                i2c_reg_write(i2c, TWSD);
+            } else
+#endif
+#if defined(I2C_DEFERRED)
+            if ((i2c->state & I2C_STATE_DEFERRED)) {
+                if ((i2c_rx_index_t)(i2c->rxHead - i2c->rxTail) >= I2C_RX_BUFFER_LENGTH) {
+                    // no room until poll() releases older payloads
+                    I2C_STAT(overruns);
+                    I2C_STAT(nacks);
+                    I2C_TRACE(I2C_TRACE_NACK, status);
+                    TWSCRB = (B0110 | TWI_HIGH_NOISE_MODE); // Send NACK and wait for any START condition
+                    return;
+                }
+                i2c->rxBuffer[i2c->rxHead++ & I2C_RX_BUFFER_MASK] = TWSD;
+            } else
+#endif
+            if ((i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex) < I2C_RX_BUFFER_LENGTH) {
+                i2c->rxBuffer[i2c->rxBufferLength++ & I2C_RX_BUFFER_MASK] = TWSD;
+#if defined(I2C_RX_STREAMING)
+                if (I2C_HAS_ON_RECEIVE_CHUNK && !(i2c->state & I2C_STATE_HANDLER)
+                    && (i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex) >= I2C_RX_CHUNK_LENGTH) {
+                    TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
+                    i2c_deliver(i2c);
+                    return;
+                }
+            } else if ((i2c->state & I2C_STATE_HANDLER)) {
+                // onReceiveChunk() handler is still running; hold SCL until it returns
+                TWSCRA &= ~_BV(TWDIE);
+                return;
+#endif
             } else {
                 // buffer overrun
+                I2C_STAT(overruns);
+                I2C_STAT(nacks);
+                I2C_TRACE(I2C_TRACE_NACK, status);
                 TWSCRB = (B0110 | TWI_HIGH_NOISE_MODE); // Send NACK and wait for any START condition
                 return;
             }
@@ -261,10 +1719,61 @@ void i2c_isr_handler()
     TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
 }
 
+#if defined(I2C_FAST_PATH)
+// ------------------------------------------------------------------------------------------------------
+// Fast path - moves a data byte of a transaction marked by i2c_fast_ok() ahead of the full handler
+// return: true if the byte is done
+//
+static inline boolean i2c_fast_path(struct i2cStruct* i2c)
+{
+    byte status = TWSSRA;
+
+    if (!i2c->fast || (status & (_BV(TWDIF) | _BV(TWASIF) | _BV(TWC) | _BV(TWBE))) != _BV(TWDIF)) {
+        return false; // address, STOP, or error
+    }
+    if ((status & _BV(TWDIR))) {
+        if (i2c->txBufferIndex == i2c->txBufferLength) return false; // Tx buffer is empty
+        TWSD = i2c->txBuffer[i2c->txBufferIndex++ & I2C_TX_BUFFER_MASK];
+    } else {
+        if ((i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex) >= I2C_RX_BUFFER_LENGTH) return false; // Rx buffer is full
+        i2c->rxBuffer[i2c->rxBufferLength++ & I2C_RX_BUFFER_MASK] = TWSD;
+    }
+#if defined(I2C_SMBUS)
+    i2c->activity++;
+#endif
+    TWSCRB = (B0011 | TWI_HIGH_NOISE_MODE);
+    return true;
+}
+#endif
+
 ISR(TWI_SLAVE_vect)
 {
+#if defined(I2C_FAST_PATH)
+    if (i2c_fast_path(Wire.i2c)) return;
+#endif
     I2C_INTR_FLAG_ON;
+#if defined(I2C_SLEEP)
+    uint16_t wake = I2C_SLEEP_TIMER;
+#endif
+#if defined(I2C_STATS)
+    uint16_t start = I2C_STATS_TIMER;
+#endif
     i2c_isr_handler();
+#if defined(I2C_STATS)
+    struct i2cStats* stats = &(Wire.i2c->stats);
+    uint16_t time = I2C_STATS_TIMER - start;
+    if (time > stats->isrMax) {
+        stats->isrMax = time;
+    }
+    stats->isrTotal += time;
+#endif
+#if defined(I2C_SLEEP)
+    if (Wire.i2c->sleeping) {
+        // the first interrupt after the wake; SCL has been held since the address match
+        Wire.i2c->wakeLatency = I2C_SLEEP_TIMER - wake;
+        Wire.i2c->sleeping = 0;
+    }
+#endif
     I2C_INTR_FLAG_OFF;
 }
 
@@ -39,54 +39,450 @@
 // ======================================================================================================
 
 // ------------------------------------------------------------------------------------------------------
-// Tx/Rx buffer sizes - modify these as needed.
+// Tx/Rx buffer sizes - modify these as needed (must be a power of two).  The Rx and Tx buffers are
+//                      separate and each I2C_BUFFER_LENGTH, the size of the single buffer of the
+//                      original library, by default.  A direction that is not used (or is served by
+//                      setRegisters() or setTxSource()) can be given a buffer as small as 1 byte to
+//                      save SRAM.
 //
 #define I2C_BUFFER_LENGTH 64
+#define I2C_RX_BUFFER_LENGTH I2C_BUFFER_LENGTH
+#define I2C_TX_BUFFER_LENGTH I2C_BUFFER_LENGTH
+
+// ------------------------------------------------------------------------------------------------------
+// Features - uncomment the features used.  Each one costs flash, SRAM, and ISR cycles; with none of them
+//            the library is the plain buffered slave.
+//
+//#define I2C_TX_STREAMING   // Wire.onRequestMore()
+//#define I2C_RX_STREAMING   // Wire.onReceiveChunk()
+//#define I2C_TX_SOURCE      // Wire.setTxSource()
+//#define I2C_REGISTER_MAP   // Wire.setRegisters()
+//#define I2C_DEFERRED       // Wire.setDeferred(), Wire.poll()
+//#define I2C_TENBIT_TABLE   // Wire.setTenBitAddress()
+//#define I2C_SMBUS          // Wire.setPEC(), Wire.writeBlock(), Wire.readBlock(), Wire.checkTimeout()
+//#define I2C_SNAPSHOT       // Wire.setSnapshot(), Wire.getSnapshot(), Wire.publishSnapshot()
+//#define I2C_SLEEP          // Wire.sleepUntilActivity(), Wire.getWakeLatency()
+//#define I2C_GENERAL_CALL   // Wire.setGeneralCall(), Wire.onGeneralCall()
+
+// ------------------------------------------------------------------------------------------------------
+// Modules - uncomment to build the device emulators that come with this library.  All sources of a library
+//           are compiled with every sketch, so they are kept out of the build unless enabled here.
+//
+//#define I2C_EEPROM_EMULATOR // VirtualEEPROM (see WireS_EEPROM.h)
+//#define I2C_FIRMWARE_UPDATE // FirmwareUpdate (see WireS_Update.h)
+
+// ------------------------------------------------------------------------------------------------------
+// Static handlers - uncomment and set below to bind a handler function of the sketch at compile time
+//                   instead of registering it by Wire.onXxx().  The ISR then calls the function directly
+//                   without NULL check, so that the compiler can inline it with link time optimization.
+//                   The function must have exactly the same parameter types as the Wire.onXxx() handler.
+//
+//#define I2C_STATIC_ON_ADDR_RECEIVE  addressEvent
+//#define I2C_STATIC_ON_RECEIVE       receiveEvent
+//#define I2C_STATIC_ON_RECEIVE_CHUNK receiveChunkEvent
+//#define I2C_STATIC_ON_REQUEST       requestEvent
+//#define I2C_STATIC_ON_REQUEST_MORE  requestMoreEvent
+//#define I2C_STATIC_ON_STOP          stopEvent
+//#define I2C_STATIC_ON_GENERAL_CALL  generalCallEvent
+
+// ------------------------------------------------------------------------------------------------------
+// Tx refill level - when the number of bytes waiting in the Tx buffer drops to this level during a
+//                   master read, the onRequestMore() handler is called to top up the buffer.
+//
+#define I2C_TX_REFILL_LEVEL (I2C_TX_BUFFER_LENGTH / 2)
+
+// ------------------------------------------------------------------------------------------------------
+// Register write queue length - number of master writes to a register file (see setRegisters()) that
+//                               are kept for getRegisterWrite(); must be a power of two, or 0 to disable.
+//
+#define I2C_REG_QUEUE_LENGTH 4
+
+// ------------------------------------------------------------------------------------------------------
+// Event queue length - number of transactions the ISR can queue for Wire.poll() in deferred mode;
+//                      must be a power of two.
+//
+#define I2C_EVENT_QUEUE_LENGTH 4
+
+// ------------------------------------------------------------------------------------------------------
+// Device table length - number of virtual devices (see setDevice()) selected by the lowest bits of the
+//                       matched address; must be a power of two, or 0 to disable.
+//
+#define I2C_DEVICE_TABLE_LENGTH 0
+
+// ------------------------------------------------------------------------------------------------------
+// SMBus PEC table - 256 for byte-wise table lookup (256 bytes of flash, fastest), or 16 for nibble-wise
+//                   lookup (16 bytes of flash, two lookups per byte).
+//
+#define I2C_SMBUS_PEC_TABLE 16
+
+// ------------------------------------------------------------------------------------------------------
+// SMBus timeout - milliseconds a transaction may stay without bus activity before Wire.checkTimeout()
+//                 resets the interface (SMBus specifies 25 to 35 ms of clock low).
+//
+#define I2C_SMBUS_TIMEOUT 25
 
 // ------------------------------------------------------------------------------------------------------
 // Interrupt flag - uncomment and set below to make the specified pin high whenever the
 //                  I2C interrupt occurs.  This is useful as a trigger signal when using a logic analyzer.
+//                  The pin is driven by direct port writes, so that it hardly changes the ISR timing.
 //
 //#define I2C_INTR_FLAG_PIN 6
 
+// ------------------------------------------------------------------------------------------------------
+// General call commands - a general call write beginning with one of these bytes is taken by the ISR itself
+//                         and reported to the onGeneralCall() handler instead of being received.
+//                         RESET is that of the I2C-bus specification; SYNC is this library's own trigger
+//                         (an even number other than 0x00, 0x04, and 0x06, which the specification reserves).
+//
+#define I2C_GENERAL_CALL_RESET 0x06
+#define I2C_GENERAL_CALL_SYNC  0x0A
+
+// ------------------------------------------------------------------------------------------------------
+// Sleep - I2C_SLEEP_MODE is the mode Wire.sleepUntilActivity() enters between transactions.  The TWI slave of
+//         all supported parts wakes the device from power-down on address match and holds SCL low until
+//         the address is acknowledged, so nothing is lost.  Within a transaction idle is entered instead,
+//         as only address match wakes from the deeper modes.  I2C_SLEEP_TIMER is the free running timer
+//         used to measure the wake-to-ACK latency.
+//
+#define I2C_SLEEP_MODE  SLEEP_MODE_PWR_DOWN
+#define I2C_SLEEP_TIMER TCNT1
+
+// ------------------------------------------------------------------------------------------------------
+// Statistics - uncomment to count bus events and time the ISR (see Wire.getStats()).  The ISR is timed
+//              by reading I2C_STATS_TIMER, a free running counter, on entry and exit; the times are in
+//              its counts (CPU cycles if the timer is clocked without prescaler).
+//
+//#define I2C_STATS
+#define I2C_STATS_TIMER TCNT1
+
+// ------------------------------------------------------------------------------------------------------
+// Statistics register - uncomment and set below to let a master read the statistics (struct i2cStats,
+//                       LSB first) by writing this byte and reading after a repeated START.
+//                       The onRequest() handler is not called for such a read.
+//
+//#define I2C_STATS_REGISTER 0xFF
+
+// ------------------------------------------------------------------------------------------------------
+// Trace - uncomment and set below to record the last I2C_TRACE_LENGTH bus events (power of two, up to 128)
+//         in a ring of 2-byte records; see Wire.dumpTrace() and extras/i2c_trace_decode.py.
+//         Each record keeps the I2C_TRACE_TIMER ticks since the previous one (saturated at 31), so
+//         choose a timer running slow enough for the bus speed (TCNT0 of the Arduino core ticks every
+//         64 CPU cycles).
+//
+//#define I2C_TRACE_LENGTH 64
+#define I2C_TRACE_TIMER TCNT0
+
+// ------------------------------------------------------------------------------------------------------
+// Trace register - uncomment and set below to let a master read the trace (the number of records followed
+//                  by the records, oldest first) by writing this byte and reading after a repeated START.
+//                  Tracing pauses until the next START or STOP.  Needs I2C_TX_SOURCE.
+//
+//#define I2C_TRACE_REGISTER 0xFE
+
+// ------------------------------------------------------------------------------------------------------
+// Fast path - uncomment to let the ISR move the data bytes of a plain buffered transfer (no register
+//             file, streaming handler, PEC, or general call) before anything else is tested.  Address,
+//             STOP, and error events, and a data byte finding the buffer full or empty, go on to the full
+//             handler.  Ignored with I2C_STATS, I2C_TRACE_LENGTH, or I2C_INTR_FLAG_PIN, which are to see
+//             every interrupt.
+//
+//#define I2C_FAST_PATH
+
 // ======================================================================================================
 // == End User Define Section ===========================================================================
 // ======================================================================================================
 
+#if (I2C_RX_BUFFER_LENGTH < 1) || (I2C_RX_BUFFER_LENGTH & (I2C_RX_BUFFER_LENGTH - 1))
+    #error "I2C_RX_BUFFER_LENGTH must be a power of two"
+#endif
+#if (I2C_TX_BUFFER_LENGTH < 1) || (I2C_TX_BUFFER_LENGTH & (I2C_TX_BUFFER_LENGTH - 1))
+    #error "I2C_TX_BUFFER_LENGTH must be a power of two"
+#endif
+#if defined(I2C_RX_STREAMING) && (I2C_RX_BUFFER_LENGTH < 2)
+    #error "I2C_RX_STREAMING needs I2C_RX_BUFFER_LENGTH of 2 or more"
+#endif
+#define I2C_RX_BUFFER_MASK (I2C_RX_BUFFER_LENGTH - 1)
+#define I2C_TX_BUFFER_MASK (I2C_TX_BUFFER_LENGTH - 1)
+#if !defined(I2C_REGISTER_MAP)
+    #undef  I2C_REG_QUEUE_LENGTH
+    #define I2C_REG_QUEUE_LENGTH 0
+#endif
+#if (I2C_REG_QUEUE_LENGTH & (I2C_REG_QUEUE_LENGTH - 1))
+    #error "I2C_REG_QUEUE_LENGTH must be a power of two"
+#endif
+#if defined(I2C_DEFERRED) && ((I2C_EVENT_QUEUE_LENGTH < 1) || (I2C_EVENT_QUEUE_LENGTH & (I2C_EVENT_QUEUE_LENGTH - 1)))
+    #error "I2C_EVENT_QUEUE_LENGTH must be a power of two"
+#endif
+#if (I2C_DEVICE_TABLE_LENGTH & (I2C_DEVICE_TABLE_LENGTH - 1))
+    #error "I2C_DEVICE_TABLE_LENGTH must be a power of two"
+#endif
+#if defined(I2C_SMBUS) && (I2C_SMBUS_PEC_TABLE != 16) && (I2C_SMBUS_PEC_TABLE != 256)
+    #error "I2C_SMBUS_PEC_TABLE must be 16 or 256"
+#endif
+#define I2C_RX_CHUNK_LENGTH (I2C_RX_BUFFER_LENGTH / 2) // onReceiveChunk() is called on every half of Rx buffer
+
+// ------------------------------------------------------------------------------------------------------
+// Buffer index types - the indices are running counters wrapping around at the size of these types, so
+//                      that 8-bit indices (loaded and stored atomically) are used whenever possible.
+//
+#if I2C_RX_BUFFER_LENGTH <= 128
+typedef uint8_t  i2c_rx_index_t;
+#else
+typedef uint16_t i2c_rx_index_t;
+#endif
+#if I2C_TX_BUFFER_LENGTH <= 128
+typedef uint8_t  i2c_tx_index_t;
+#else
+typedef uint16_t i2c_tx_index_t;
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Tx source kinds - see setTxSource()
+//
+#define I2C_SOURCE_NONE    0
+#define I2C_SOURCE_RAM     1
+#define I2C_SOURCE_PROGMEM 2
+#if defined(E2END) && E2END
+#define I2C_SOURCE_EEPROM  3 // only on parts with EEPROM (not ATtiny20/40)
+#endif
+#define I2C_SOURCE_WRAP    0x80 // or'ed with above: wrap around at the end of source
+#if defined(I2C_SOURCE_EEPROM)
+#define I2C_SOURCE_LAST    I2C_SOURCE_EEPROM
+#else
+#define I2C_SOURCE_LAST    I2C_SOURCE_PROGMEM
+#endif
+
 // ------------------------------------------------------------------------------------------------------
 // Interrupt flag setup
 //
 #if defined(I2C_INTR_FLAG_PIN)
-    #define I2C_INTR_FLAG_INIT do             \
-    {                                         \
-        pinMode(I2C_INTR_FLAG_PIN, OUTPUT);   \
-        digitalWrite(I2C_INTR_FLAG_PIN, LOW); \
+    // the port and bit of the pin are looked up once at begin() (i2c_intr_flag_xxx in WireS.cpp)
+    #define I2C_INTR_FLAG_INIT do                                                     \
+    {                                                                                 \
+        pinMode(I2C_INTR_FLAG_PIN, OUTPUT);                                           \
+        i2c_intr_flag_port = portOutputRegister(digitalPinToPort(I2C_INTR_FLAG_PIN)); \
+        i2c_intr_flag_mask = digitalPinToBitMask(I2C_INTR_FLAG_PIN);                  \
+        I2C_INTR_FLAG_OFF;                                                            \
     } while(0)
 
-    #define I2C_INTR_FLAG_ON   do {digitalWrite(I2C_INTR_FLAG_PIN, HIGH);} while(0)
-    #define I2C_INTR_FLAG_OFF  do {digitalWrite(I2C_INTR_FLAG_PIN, LOW);} while(0)
+    #define I2C_INTR_FLAG_ON   do {*i2c_intr_flag_port |= i2c_intr_flag_mask;} while(0)
+    #define I2C_INTR_FLAG_OFF  do {*i2c_intr_flag_port &= ~i2c_intr_flag_mask;} while(0)
 #else
     #define I2C_INTR_FLAG_INIT do{}while(0)
     #define I2C_INTR_FLAG_ON   do{}while(0)
     #define I2C_INTR_FLAG_OFF  do{}while(0)
 #endif
 
+#if defined(I2C_SNAPSHOT) && !defined(I2C_REGISTER_MAP) && !defined(I2C_TX_SOURCE)
+    #error "I2C_SNAPSHOT needs I2C_REGISTER_MAP or I2C_TX_SOURCE"
+#endif
+#if defined(I2C_TRACE_LENGTH) && ((I2C_TRACE_LENGTH & (I2C_TRACE_LENGTH - 1)) || I2C_TRACE_LENGTH > 128)
+    #error "I2C_TRACE_LENGTH must be a power of two up to 128"
+#endif
+#if defined(I2C_TRACE_REGISTER) && (!defined(I2C_TRACE_LENGTH) || !defined(I2C_TX_SOURCE))
+    #error "I2C_TRACE_REGISTER needs I2C_TRACE_LENGTH and I2C_TX_SOURCE"
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Trace record - event type (upper 3 bits) | ticks since previous record (lower 5 bits), value
+//
+#define I2C_TRACE_START    0x00 // value = address byte (incl. R/W bit; the 1st byte of 10-bit address)
+#define I2C_TRACE_RESTART  0x20 // value = address byte after repeated START
+#define I2C_TRACE_RX       0x40 // value = byte received (the 2nd byte of 10-bit address too)
+#define I2C_TRACE_TX       0x60 // value = byte sent
+#define I2C_TRACE_STOP     0x80 // value = 0
+#define I2C_TRACE_NACK     0xA0 // value = TWSSRA when NACK is sent
+#define I2C_TRACE_ERROR    0xC0 // value = TWSSRA at bus error (TWBE) or collision (TWC)
+#define I2C_TRACE_UNDERRUN 0xE0 // value = 0; no more data for master read
+#define I2C_TRACE_TICKS    0x1F
+
+#if defined(I2C_STATS_REGISTER) && !defined(I2C_STATS)
+    #define I2C_STATS
+#endif
+#if defined(I2C_FAST_PATH) && (defined(I2C_STATS) || defined(I2C_TRACE_LENGTH) || defined(I2C_INTR_FLAG_PIN))
+    #undef  I2C_FAST_PATH
+#endif
+#if defined(I2C_STATS)
+// ------------------------------------------------------------------------------------------------------
+// Statistics - counters wrap around
+//
+struct i2cStats
+{
+    uint16_t transactions;                   // transactions addressed to the device
+    uint16_t repeatedStarts;                 // repeated STARTs addressed to the device
+    uint16_t rxBytes;                        // data bytes received
+    uint16_t txBytes;                        // data bytes sent
+    uint16_t nacks;                          // NACKs sent
+    uint16_t overruns;                       // data bytes NACKed for lack of Rx buffer
+    uint16_t underruns;                      // master reads beyond the data
+    uint16_t busErrors;                      // TWBE
+    uint16_t collisions;                     // TWC
+    uint16_t interrupts;                     // ISR invocations
+    uint16_t isrMax;                         // longest ISR time in I2C_STATS_TIMER counts
+    uint32_t isrTotal;                       // total ISR time in I2C_STATS_TIMER counts
+};
+#endif
+
+#if defined(I2C_DEFERRED)
+// ------------------------------------------------------------------------------------------------------
+// Transaction record - queued by the ISR in deferred mode and processed by Wire.poll()
+//
+#define I2C_EVENT_READ 0x01 // master read (otherwise master write)
+#define I2C_EVENT_STOP 0x02 // ended by STOP (otherwise by repeated START)
+
+struct i2cEvent
+{
+    uint16_t       addr;                     // address as getRxAddr()
+    char           startCount;               // repeated START count
+    uint8_t        flags;                    // I2C_EVENT_READ, I2C_EVENT_STOP
+    i2c_rx_index_t start;                    // Rx payload start (master write)
+    size_t         count;                    // Rx payload length (master write) or bytes sent (master read)
+};
+#endif
+
+#if I2C_DEVICE_TABLE_LENGTH
+// ------------------------------------------------------------------------------------------------------
+// Virtual device - the handlers and register map served at one address of the device table
+//                  (see setDevice()); handlers left NULL are not called
+//
+struct i2cDevice
+{
+#if !defined(I2C_STATIC_ON_ADDR_RECEIVE)
+    boolean (*onAddrReceive)(uint16_t, uint8_t);
+#endif
+#if !defined(I2C_STATIC_ON_RECEIVE)
+    void (*onReceive)(size_t);
+#endif
+#if defined(I2C_RX_STREAMING) && !defined(I2C_STATIC_ON_RECEIVE_CHUNK)
+    void (*onReceiveChunk)(const uint8_t*, size_t);
+#endif
+#if !defined(I2C_STATIC_ON_REQUEST)
+    void (*onRequest)(void);
+#endif
+#if defined(I2C_TX_STREAMING) && !defined(I2C_STATIC_ON_REQUEST_MORE)
+    void (*onRequestMore)(void);
+#endif
+#if !defined(I2C_STATIC_ON_STOP)
+    void (*onStop)(void);
+#endif
+#if defined(I2C_REGISTER_MAP)
+    volatile uint8_t* regs;                  // register file, or NULL for handler mode
+    const uint8_t*    regMask;               // write masks, or NULL if all bits are writable
+    uint8_t           regSize;               // number of registers
+    uint8_t           regPointer;            // register pointer kept while another device is selected
+#endif
+};
+#endif
+
 // ------------------------------------------------------------------------------------------------------
 // Main I2C data structure
 //
 struct i2cStruct
 {
-    uint8_t  Buffer[I2C_BUFFER_LENGTH];      // Tx/Rx Buffer                      (ISR)
-    volatile size_t   rxBufferIndex;         // Rx Index                          (User&ISR)
-    volatile size_t   rxBufferLength;        // Rx Length                         (ISR)
-    volatile size_t   txBufferIndex;         // Tx Index                          (User&ISR)
-    volatile size_t   txBufferLength;        // Tx Length                         (User&ISR)
+    uint8_t  rxBuffer[I2C_RX_BUFFER_LENGTH]; // Rx Buffer                         (ISR)
+    uint8_t  txBuffer[I2C_TX_BUFFER_LENGTH]; // Tx Buffer                         (User&ISR)
+    volatile i2c_rx_index_t rxBufferIndex;   // Rx Index                          (User&ISR)
+    volatile i2c_rx_index_t rxBufferLength;  // Rx Length                         (ISR)
+    volatile i2c_tx_index_t txBufferIndex;   // Tx Index (bytes sent)             (User&ISR)
+    volatile i2c_tx_index_t txBufferLength;  // Tx Length (bytes written)         (User&ISR)
     volatile char     startCount;            // repeated START count              (User&ISR)
     volatile uint16_t  Addr;                 // Tx/Rx address                     (User&ISR)
+    volatile uint8_t  state;                 // ISR state flags                   (User&ISR)
+#if defined(I2C_FAST_PATH)
+    volatile uint8_t  fast;                  // data bytes may take the fast path (ISR)
+#endif
+#if defined(I2C_DEFERRED)
+    volatile i2c_rx_index_t rxHead;          // Deferred Rx Head                  (ISR)
+    volatile i2c_rx_index_t rxTail;          // Deferred Rx Tail                  (User)
+    struct i2cEvent eventQueue[I2C_EVENT_QUEUE_LENGTH]; // Transaction Queue        (ISR)
+    volatile uint8_t  eventQueueHead;        // Transaction Queue Head            (ISR)
+    volatile uint8_t  eventQueueTail;        // Transaction Queue Tail            (User)
+    struct i2cEvent*  polled;                // Transaction being polled          (User)
+    i2c_tx_index_t    txStagedLength;        // Tx Length staged by onRequest()   (User)
+#endif
+#if defined(I2C_TX_SOURCE)
+    const uint8_t*    txSource;              // Tx Source                         (User&ISR)
+    size_t            txSourceLength;        // Tx Source Length                  (User&ISR)
+    volatile size_t   txSourceIndex;         // Tx Source Index                   (User&ISR)
+    volatile uint8_t  txSourceKind;          // Tx Source Kind                    (User&ISR)
+#endif
+#if defined(I2C_REGISTER_MAP)
+    volatile uint8_t* regs;                  // Register File                     (User&ISR)
+    const uint8_t*    regMask;               // Register Write Masks              (User&ISR)
+    uint8_t           regSize;               // Register File Size                (User&ISR)
+    volatile uint8_t  regPointer;            // Register Pointer                  (User&ISR)
+    uint8_t           regFirst;              // First Register written            (ISR)
+    uint8_t           regCount;              // Number of Registers written       (ISR)
+#if I2C_REG_QUEUE_LENGTH
+    struct { uint8_t first, count; } regQueue[I2C_REG_QUEUE_LENGTH]; // Register Write Queue (ISR)
+    volatile uint8_t  regQueueHead;          // Register Write Queue Head         (ISR)
+    volatile uint8_t  regQueueTail;          // Register Write Queue Tail         (User)
+#endif
+#endif
+#if defined(I2C_SNAPSHOT)
+    uint8_t*          snapshot[2];           // Snapshot Buffers                  (User&ISR)
+    uint8_t           snapshotLength;        // Snapshot Length, 0 if none        (User&ISR)
+    uint8_t           snapshotFirst;         // First Register of Snapshot        (User&ISR)
+    volatile uint8_t  snapshotFront;         // Published Snapshot (0 or 1)       (User&ISR)
+    volatile uint8_t  snapshotSending;       // Snapshot latched by master read   (User&ISR)
+#endif
+#if defined(I2C_TENBIT_TABLE)
+    const uint16_t*   tenbitList;            // 10-bit Address Table              (User&ISR)
+    uint16_t          tenbitAddress;         // 10-bit Address (single)           (User&ISR)
+    uint16_t          tenbitMask;            // 10-bit Address Mask               (User&ISR)
+    uint8_t           tenbitCount;           // 10-bit Address Table Size         (User&ISR)
+#endif
+#if defined(I2C_STATS)
+    struct i2cStats   stats;                 // Statistics                        (ISR)
+#endif
+#if defined(I2C_TRACE_LENGTH)
+    uint8_t           trace[2 * I2C_TRACE_LENGTH]; // Trace Ring                  (User&ISR)
+    volatile uint8_t  traceHead;             // records written (running counter) (User&ISR)
+    volatile uint8_t  traceCount;            // records in ring                   (User&ISR)
+    uint8_t           traceTime;             // I2C_TRACE_TIMER at last record    (ISR)
+    volatile uint8_t  tracePaused;           // I2C_TRACE_PAUSED_xxx flags        (User&ISR)
+#endif
+#if defined(I2C_SLEEP)
+    volatile uint8_t  sleeping;              // set while sleeping in I2C_SLEEP_MODE (User&ISR)
+    volatile uint16_t wakeLatency;           // ISR entry to ACK after last wake  (User&ISR)
+#endif
+#if defined(I2C_SMBUS)
+    volatile uint8_t  smbus;                 // SMBus flags                       (User&ISR)
+    volatile uint8_t  pec;                   // running PEC                       (ISR)
+    volatile uint8_t  pecErrors;             // messages discarded for bad PEC    (User&ISR)
+    volatile uint8_t  activity;              // interrupt count for timeout       (ISR)
+    uint8_t           timeoutActivity;       // interrupt count at timeoutStart   (User)
+    unsigned long     timeoutStart;          // millis() when activity was last seen (User)
+#endif
+#if I2C_DEVICE_TABLE_LENGTH
+    struct i2cDevice* devices[I2C_DEVICE_TABLE_LENGTH]; // Device Table              (User)
+    uint16_t deviceAddr[I2C_DEVICE_TABLE_LENGTH]; // Address of each Device          (User)
+#if defined(I2C_GENERAL_CALL)
+    struct i2cDevice* generalCall;           // Device of general call (address 0) (User)
+#endif
+    struct i2cDevice* device;                // Selected Device                   (ISR)
+#endif
+#if !defined(I2C_STATIC_ON_ADDR_RECEIVE)
     boolean (*user_onAddrReceive)(uint16_t, uint8_t);  // Slave Addr Callback Function      (User)
+#endif
+#if !defined(I2C_STATIC_ON_RECEIVE)
     void (*user_onReceive)(size_t);          // Slave Rx Callback Function        (User)
+#endif
+#if defined(I2C_RX_STREAMING) && !defined(I2C_STATIC_ON_RECEIVE_CHUNK)
+    void (*user_onReceiveChunk)(const uint8_t*, size_t); // Slave Rx Chunk Callback Function (User)
+#endif
+#if !defined(I2C_STATIC_ON_REQUEST)
     void (*user_onRequest)(void);            // Slave Tx Callback Function        (User)
+#endif
+#if defined(I2C_TX_STREAMING) && !defined(I2C_STATIC_ON_REQUEST_MORE)
+    void (*user_onRequestMore)(void);        // Slave Tx Refill Callback Function (User)
+#endif
+#if !defined(I2C_STATIC_ON_STOP)
     void (*user_onStop)(void);               // Stop Callback Function            (User)
+#endif
+#if defined(I2C_GENERAL_CALL) && !defined(I2C_STATIC_ON_GENERAL_CALL)
+    void (*user_onGeneralCall)(uint8_t);     // General Call Command Callback     (User)
+#endif
 };
 
 extern "C" void i2c_isr_handler(struct i2cStruct* i2c);
@@ -141,7 +537,7 @@ public:
 
     // ------------------------------------------------------------------------------------------------------
     // Write - write data byte to Tx buffer
-    // return: 1=success, 0=fail
+    // return: 1=success, 0=fail (buffer full)
     // parameters:
     //      data = data byte
     //
@@ -153,18 +549,316 @@ public:
 
     // ------------------------------------------------------------------------------------------------------
     // Write Array - write length number of bytes from data array to Tx buffer
+    // return: number of bytes written (truncated to the free space in Tx buffer)
     // parameters:
     //      data = pointer to uint8_t (or char) array of data
     //      length = number of bytes to write
     //
     size_t write(const uint8_t* data, size_t quantity);
-    inline size_t write(const char* str) { write((const uint8_t*)str, strlen(str)); }
+    inline size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Write Value (base routine)
+    //
+    static size_t writeValue_(struct i2cStruct* i2c, const void* value, uint8_t size, boolean bigEndian);
+    //
+    // Write U16/U32 - write a 16/32-bit value to Tx buffer, LSB first (or MSB first for xxxBE)
+    // return: number of bytes written, 0 if Tx buffer has no room for all of them (nothing is written then)
+    // parameters:
+    //      value = value to write
+    //
+    inline size_t writeU16(uint16_t value)   { return writeValue_(i2c, &value, sizeof(value), false); }
+    inline size_t writeU16BE(uint16_t value) { return writeValue_(i2c, &value, sizeof(value), true); }
+    inline size_t writeU32(uint32_t value)   { return writeValue_(i2c, &value, sizeof(value), false); }
+    inline size_t writeU32BE(uint32_t value) { return writeValue_(i2c, &value, sizeof(value), true); }
+
+#if defined(I2C_TX_SOURCE)
+    // ------------------------------------------------------------------------------------------------------
+    // Set Tx Source (base routine)
+    //
+    static void setTxSource_(struct i2cStruct* i2c, const void* data, size_t length, uint8_t kind, size_t start);
+    //
+    // Set Tx Source - send bytes straight from memory once Tx buffer is emptied (zero-copy transmit)
+    // return: none
+    // parameters:
+    //      data = pointer to the source (EEPROM address for I2C_SOURCE_EEPROM)
+    //      length = size of the source
+    //      kind = I2C_SOURCE_RAM, I2C_SOURCE_PROGMEM, or I2C_SOURCE_EEPROM, optionally or'ed with
+    //             I2C_SOURCE_WRAP to restart from the beginning of the source after its end
+    //      start = offset of the first byte to send
+    //
+    inline void setTxSource(const void* data, size_t length, uint8_t kind, size_t start = 0)
+    {
+        setTxSource_(i2c, data, length, kind, start);
+    }
+#endif
+
+#if defined(I2C_REGISTER_MAP)
+    // ------------------------------------------------------------------------------------------------------
+    // Set Registers (base routine)
+    //
+    static void setRegisters_(struct i2cStruct* i2c, volatile uint8_t* regs, uint8_t size, const uint8_t* writeMask);
+    //
+    // Set Registers - serve a register file entirely inside the ISR (register map mode)
+    // return: none
+    // parameters:
+    //      regs = pointer to register array, or NULL to go back to handler mode
+    //      size = number of registers (1 to 255)
+    //      writeMask = pointer to array of per-register write masks (bits set are writable by master,
+    //                  0 for read-only register), or NULL if all bits are writable
+    //
+    inline void setRegisters(volatile uint8_t* regs, uint8_t size, const uint8_t* writeMask = NULL)
+    {
+        setRegisters_(i2c, regs, size, writeMask);
+    }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Get Register Pointer - returns current register pointer in register map mode
+    //
+    inline uint8_t getRegisterPointer(void) { return i2c->regPointer; }
+
+#if I2C_REG_QUEUE_LENGTH
+    // ------------------------------------------------------------------------------------------------------
+    // Get Register Write (base routine)
+    //
+    static boolean getRegisterWrite_(struct i2cStruct* i2c, uint8_t* first, uint8_t* count);
+    //
+    // Get Register Write - get the oldest record of registers written by master in register map mode
+    // return: true if a record is returned, false if none
+    // parameters:
+    //      first = pointer to store the first register written
+    //      count = pointer to store the number of registers written (from first, wrapping around)
+    //
+    inline boolean getRegisterWrite(uint8_t* first, uint8_t* count) { return getRegisterWrite_(i2c, first, count); }
+#endif
+#endif
+
+#if defined(I2C_SNAPSHOT)
+    // ------------------------------------------------------------------------------------------------------
+    // Set Snapshot (base routine)
+    //
+    static void setSnapshot_(struct i2cStruct* i2c, void* front, void* back, uint8_t length, uint8_t first);
+    //
+    // Set Snapshot - let master reads send from a pair of buffers that the sketch fills and publishes in turn.
+    //                The snapshot published at the address of a master read is sent throughout the read.
+    //                In register map mode it serves registers first to first + length - 1 (read only);
+    //                otherwise a read sends the snapshot from its beginning instead of calling onRequest().
+    // return: none
+    // parameters:
+    //      front = pointer to the buffer published first, or NULL to stop using snapshots
+    //      back = pointer to the other buffer
+    //      length = size of each buffer
+    //      first = first register served from the snapshot (register map mode)
+    //
+    inline void setSnapshot(void* front, void* back, uint8_t length, uint8_t first = 0)
+    {
+        setSnapshot_(i2c, front, back, length, first);
+    }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Get Snapshot - returns the buffer to fill for the next publishSnapshot(), or NULL while a master read
+    //                is still sending it (try again later)
+    //
+    static void* getSnapshot_(struct i2cStruct* i2c);
+    inline void* getSnapshot(void) { return getSnapshot_(i2c); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Publish Snapshot - makes the buffer returned by getSnapshot() current for the following master reads
+    //
+    inline void publishSnapshot(void) { i2c->snapshotFront ^= 1; }
+#endif
+
+#if defined(I2C_GENERAL_CALL)
+    // ------------------------------------------------------------------------------------------------------
+    // Set General Call (base routine)
+    //
+    static void setGeneralCall_(struct i2cStruct* i2c, boolean enable);
+    //
+    // Set General Call - respond to the general call address 0x00 too.  A general call write goes to
+    //                    the device set by setDevice(0, ...) when the device table is in use (e.g. a register
+    //                    map shared by all slaves; it takes no table entry), and to the handlers otherwise,
+    //                    with getRxAddr() of 0.
+    //                    The I2C_GENERAL_CALL_xxx commands are taken by the ISR; see onGeneralCall().
+    // return: none
+    // parameters:
+    //      enable = true to respond to general call
+    //
+    inline void setGeneralCall(boolean enable) { setGeneralCall_(i2c, enable); }
+#endif
+
+#if defined(I2C_SLEEP)
+    // ------------------------------------------------------------------------------------------------------
+    // Sleep Until Activity (base routine)
+    //
+    static uint8_t sleepUntilActivity_(struct i2cStruct* i2c);
+    //
+    // Sleep Until Activity - sleep until an interrupt; in I2C_SLEEP_MODE between transactions (the TWI wakes
+    //                        the device on address match), in idle within a transaction
+    // return: sleep mode entered (SLEEP_MODE_xxx)
+    //
+    inline uint8_t sleepUntilActivity(void) { return sleepUntilActivity_(i2c); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Get Wake Latency - returns I2C_SLEEP_TIMER counts from the ISR entry to the address ACK after the last
+    //                    wake from I2C_SLEEP_MODE (the oscillator start-up time set by fuses is not included)
+    //
+    inline uint16_t getWakeLatency(void) { return i2c->wakeLatency; }
+#endif
+
+#if defined(I2C_STATS)
+    // ------------------------------------------------------------------------------------------------------
+    // Get Statistics (base routine)
+    //
+    static void getStats_(struct i2cStruct* i2c, struct i2cStats* stats, boolean clear);
+    //
+    // Get Statistics - copy a consistent snapshot of the statistics
+    // return: none
+    // parameters:
+    //      stats = pointer to store the statistics
+    //      clear = true to clear the statistics after the copy
+    //
+    inline void getStats(struct i2cStats* stats, boolean clear = false) { getStats_(i2c, stats, clear); }
+#endif
+
+#if defined(I2C_TRACE_LENGTH)
+    // ------------------------------------------------------------------------------------------------------
+    // Dump Trace (base routine)
+    //
+    static void dumpTrace_(struct i2cStruct* i2c, Print& out, boolean clear);
+    //
+    // Dump Trace - print the trace as text for extras/i2c_trace_decode.py; tracing pauses meanwhile
+    // return: none
+    // parameters:
+    //      out = where to print (e.g. Serial)
+    //      clear = true to clear the trace after the dump
+    //
+    inline void dumpTrace(Print& out, boolean clear = false) { dumpTrace_(i2c, out, clear); }
+#endif
+
+#if defined(I2C_SMBUS)
+    // ------------------------------------------------------------------------------------------------------
+    // Set PEC (base routine)
+    //
+    static void setPEC_(struct i2cStruct* i2c, boolean pec);
+    //
+    // Set PEC - SMBus Packet Error Code; the ISR updates PEC on every byte, appends it to the response
+    //           of a master read, and checks and strips it from a master write before onReceive()
+    // return: none
+    // parameters:
+    //      pec = true to enable PEC
+    //
+    inline void setPEC(boolean pec) { setPEC_(i2c, pec); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Get PEC Errors - returns the number of master writes discarded for bad PEC (modulo 256)
+    //
+    inline uint8_t getPECErrors(void) { return i2c->pecErrors; }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Write Block - write byte count followed by data to Tx buffer (SMBus block read)
+    // return: number of data bytes written, 0 if Tx buffer has no room for all of them
+    // parameters:
+    //      data = pointer to uint8_t array of data
+    //      length = number of bytes to write (0 to 255)
+    //
+    size_t writeBlock(const uint8_t* data, uint8_t length);
+
+    // ------------------------------------------------------------------------------------------------------
+    // Read Block (base routine)
+    //
+    static uint8_t readBlock_(struct i2cStruct* i2c, uint8_t* data, uint8_t maxLength);
+    //
+    // Read Block - read byte count followed by data from Rx buffer (SMBus block write)
+    // return: byte count sent by master (the data stored is truncated to maxLength)
+    // parameters:
+    //      data = pointer to uint8_t array to store data
+    //      maxLength = size of data array
+    //
+    inline uint8_t readBlock(uint8_t* data, uint8_t maxLength) { return readBlock_(i2c, data, maxLength); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Check Timeout (base routine)
+    //
+    static boolean checkTimeout_(struct i2cStruct* i2c);
+    //
+    // Check Timeout - resets the interface if a transaction has seen no bus activity for I2C_SMBUS_TIMEOUT
+    //                 milliseconds (SMBus clock low timeout); call this from loop()
+    // return: true if the interface was reset
+    //
+    inline boolean checkTimeout(void) { return checkTimeout_(i2c); }
+#endif
+
+#if defined(I2C_TENBIT_TABLE)
+    // ------------------------------------------------------------------------------------------------------
+    // Set 10-bit Address (base routine)
+    //
+    static void setTenBitAddress_(struct i2cStruct* i2c, uint16_t address, const uint16_t* list, uint8_t count, uint16_t mask);
+    //
+    // Set 10-bit Address - the ISR ACKs only the 10-bit addresses in the table and NACKs the others
+    //                      without calling the onAddrReceive() handler
+    // return: none
+    // parameters:
+    //      address = 10bit slave address
+    //      list = pointer to array of 10bit slave addresses (kept by the caller), or NULL to disable the table
+    //      count = number of addresses in list
+    //      mask = bits ignored in the comparison (e.g. 0x00F for 16 consecutive addresses)
+    //
+    inline void setTenBitAddress(uint16_t address, uint16_t mask = 0)
+    {
+        setTenBitAddress_(i2c, address, (const uint16_t*)NULL, 1, mask);
+    }
+    inline void setTenBitAddress(const uint16_t* list, uint8_t count, uint16_t mask = 0)
+    {
+        setTenBitAddress_(i2c, 0, list, (list != NULL ? count : 0), mask);
+    }
+#endif
+
+#if I2C_DEVICE_TABLE_LENGTH
+    // ------------------------------------------------------------------------------------------------------
+    // Set Device (base routine)
+    //
+    static boolean setDevice_(struct i2cStruct* i2c, uint16_t address, struct i2cDevice* device);
+    //
+    // Set Device - serve a virtual device at address; the ISR selects the device by the lowest bits of
+    //              the matched address and NACKs the addresses with no device set
+    // return: false if the entry of the lowest bits is taken by a device of another address
+    // parameters:
+    //      address = 7bit or 10bit slave address
+    //      device = pointer to the handlers and register map of the device, or NULL to NACK the address
+    //
+    inline boolean setDevice(uint16_t address, struct i2cDevice* device) { return setDevice_(i2c, address, device); }
+#endif
+
+#if defined(I2C_DEFERRED)
+    // ------------------------------------------------------------------------------------------------------
+    // Set Deferred (base routine)
+    //
+    static void setDeferred_(struct i2cStruct* i2c, boolean deferred);
+    //
+    // Set Deferred - in deferred mode the ISR only ACKs and buffers, and queues the transactions
+    //                for Wire.poll() which calls the handlers from loop()
+    // return: none
+    // parameters:
+    //      deferred = true to enter deferred mode, false to go back to calling handlers from the ISR
+    //
+    inline void setDeferred(boolean deferred) { setDeferred_(i2c, deferred); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Poll (base routine)
+    //
+    static void poll_(struct i2cStruct* i2c);
+    //
+    // Poll - calls the handlers for the transactions queued in deferred mode; call this from loop()
+    // return: none
+    //
+    inline void poll(void) { poll_(i2c); }
+#endif
 
     // ------------------------------------------------------------------------------------------------------
     // Available - returns number of remaining available bytes in Rx buffer
     // return: #bytes available
     //
-    inline int available(void) { return i2c->rxBufferLength - i2c->rxBufferIndex; }
+    inline int available(void) { return (i2c_rx_index_t)(i2c->rxBufferLength - i2c->rxBufferIndex); }
 
     // ------------------------------------------------------------------------------------------------------
     // Read (base routine)
@@ -206,6 +900,56 @@ public:
     //
     inline uint8_t peekByte(void) { return peekByte_(i2c); }
 
+    // ------------------------------------------------------------------------------------------------------
+    // Read Array (base routine)
+    //
+    static size_t read_(struct i2cStruct* i2c, uint8_t* data, size_t quantity);
+    //
+    // Read Array - read up to quantity bytes from Rx buffer to data array at once (no timeout, unlike
+    //              Stream::readBytes(), which the readBytes() below replace)
+    // return: number of bytes read
+    // parameters:
+    //      data = pointer to uint8_t (or char) array to store data
+    //      quantity = number of bytes to read
+    //
+    inline size_t read(uint8_t* data, size_t quantity) { return read_(i2c, data, quantity); }
+    inline size_t readBytes(uint8_t* data, size_t quantity) { return read_(i2c, data, quantity); }
+    inline size_t readBytes(char* data, size_t quantity) { return read_(i2c, (uint8_t*)data, quantity); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Read Value (base routine)
+    //
+    static boolean readValue_(struct i2cStruct* i2c, void* value, uint8_t size, boolean bigEndian);
+    //
+    // Read U16/U32 - returns next 16/32-bit value from Rx buffer, LSB first (or MSB first for xxxBE)
+    // return: value, 0 if Rx buffer has fewer bytes (nothing is removed then)
+    //
+    inline uint16_t readU16(void)   { uint16_t v = 0; readValue_(i2c, &v, sizeof(v), false); return v; }
+    inline uint16_t readU16BE(void) { uint16_t v = 0; readValue_(i2c, &v, sizeof(v), true); return v; }
+    inline uint32_t readU32(void)   { uint32_t v = 0; readValue_(i2c, &v, sizeof(v), false); return v; }
+    inline uint32_t readU32BE(void) { uint32_t v = 0; readValue_(i2c, &v, sizeof(v), true); return v; }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Get Rx Span (base routine)
+    //
+    static size_t getRxSpan_(struct i2cStruct* i2c, const uint8_t** data);
+    //
+    // Get Rx Span - points to the next bytes in Rx buffer in place, without copying or removing them.
+    //               The span ends where Rx buffer wraps around; skip() it and call again for the rest.
+    //               A payload received from the beginning of a transaction fits in one span.
+    // return: number of contiguous bytes at *data
+    // parameters:
+    //      data = pointer to store the pointer to the bytes
+    //
+    inline size_t getRxSpan(const uint8_t** data) { return getRxSpan_(i2c, data); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Skip - removes up to quantity bytes from Rx buffer
+    // return: number of bytes removed
+    //
+    static size_t skip_(struct i2cStruct* i2c, size_t quantity);
+    inline size_t skip(size_t quantity) { return skip_(i2c, quantity); }
+
     // ------------------------------------------------------------------------------------------------------
     // Flush (not implemented)
     //
@@ -215,33 +959,72 @@ public:
     // Get Rx Address - returns target address of incoming I2C command.
     // return: address of last received command
     //
+#if defined(I2C_DEFERRED)
+    inline uint16_t getRxAddr(void) { return (i2c->polled != NULL ? i2c->polled->addr : i2c->Addr); }
+#else
     inline uint16_t getRxAddr(void) { return i2c->Addr; }
+#endif
 
     // ------------------------------------------------------------------------------------------------------
     // Get number of sent bytes
-    // return: number of bytes actually sent via last transmission.
+    // return: number of bytes actually sent via last transmission (modulo 256 if I2C_TX_BUFFER_LENGTH <= 128).
     //
+#if defined(I2C_DEFERRED)
+    inline size_t getTransmitBytes(void) { return (i2c->polled != NULL ? i2c->polled->count : i2c->txBufferIndex); }
+#else
     inline size_t getTransmitBytes(void) { return i2c->txBufferIndex; }
+#endif
 
+#if !defined(I2C_STATIC_ON_ADDR_RECEIVE)
     // ------------------------------------------------------------------------------------------------------
     // Set callback function for Slave address received
     //
     inline void onAddrReceive(boolean (*function)(uint16_t, uint8_t)) { i2c->user_onAddrReceive = function; }
+#endif
 
+#if !defined(I2C_STATIC_ON_RECEIVE)
     // ------------------------------------------------------------------------------------------------------
     // Set callback function for Slave Rx
     //
     inline void onReceive(void (*function)(size_t)) { i2c->user_onReceive = function; }
+#endif
 
+#if defined(I2C_RX_STREAMING) && !defined(I2C_STATIC_ON_RECEIVE_CHUNK)
+    // ------------------------------------------------------------------------------------------------------
+    // Set callback function for Slave Rx chunk (streaming receive)
+    //
+    inline void onReceiveChunk(void (*function)(const uint8_t*, size_t)) { i2c->user_onReceiveChunk = function; }
+#endif
+
+#if !defined(I2C_STATIC_ON_REQUEST)
     // ------------------------------------------------------------------------------------------------------
     // Set callback function for Slave Tx
     //
     inline void onRequest(void (*function)(void)) { i2c->user_onRequest = function; }
+#endif
 
+#if defined(I2C_TX_STREAMING) && !defined(I2C_STATIC_ON_REQUEST_MORE)
+    // ------------------------------------------------------------------------------------------------------
+    // Set callback function for Slave Tx refill (streaming transmit)
+    //
+    inline void onRequestMore(void (*function)(void)) { i2c->user_onRequestMore = function; }
+#endif
+
+#if !defined(I2C_STATIC_ON_STOP)
     // ------------------------------------------------------------------------------------------------------
     // Set callback function for stop received after Slave Tx
     //
     inline void onStop(void (*function)(void)) { i2c->user_onStop = function; }
+#endif
+
+#if defined(I2C_GENERAL_CALL) && !defined(I2C_STATIC_ON_GENERAL_CALL)
+    // ------------------------------------------------------------------------------------------------------
+    // Set callback function for general call commands (I2C_GENERAL_CALL_RESET or I2C_GENERAL_CALL_SYNC);
+    // called from the ISR as soon as the command byte is received, so that every slave on the bus runs it
+    // at the same time.  Keep it short, as SCL is held meanwhile.
+    //
+    inline void onGeneralCall(void (*function)(uint8_t)) { i2c->user_onGeneralCall = function; }
+#endif
 
 };
 
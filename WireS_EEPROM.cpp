@@ -0,0 +1,382 @@
+/*
+    WireS_EEPROM - I2C serial EEPROM emulator built on WireS
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Emulates 24Cxx serial EEPROMs:
+//   - Byte write and page write (the address rolls over within the page)
+//   - Current address read, random read, and sequential read of any length (rolls over at the end)
+//   - ACK polling; the device address is NACKed for a write while the write-back cache is full, and for a
+//     read of data that is not cached while internal EEPROM is being written
+//
+// Master writes land in a RAM write-back cache of I2C_EEPROM_CACHE_PAGES pages and are committed to
+// internal EEPROM by VirtualEEPROM.poll() from loop().  A byte is written to internal EEPROM only between
+// transactions.  While the write is in progress, a master write to a page not cached takes a free cache
+// line without reading the page (the bytes not written are filled in by poll() later), and a master read
+// is NACKed, as a real EEPROM does during its write cycle, only if its first byte is not in the cache.
+// The interrupt routine never waits for EEPROM: a read that runs past the cached bytes meanwhile is cut
+// off there, and master reads 0xFF for the rest.
+//
+// Each page rotates through I2C_EEPROM_WEAR_SLOTS records in internal EEPROM; a record is the page data
+// followed by a sequence number, which is written last so that a record torn by power loss is never taken
+// as the current one.  The current record of a page is the one whose successor does not carry the next
+// sequence number.
+
+#include "WireS_EEPROM.h"
+
+#if defined(WIRE_S_EEPROM_H)
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+struct i2cEepromStruct i2c_eepromS::eepromData;
+
+// address of the record of page in wear slot
+#define RECORD_ADDR(page, slot) \
+    ((uint8_t *)(I2C_EEPROM_OFFSET + ((uint16_t)(page) * I2C_EEPROM_WEAR_SLOTS + (slot)) * I2C_EEPROM_RECORD))
+#define NEXT_SLOT(slot) ((slot) + 1 < I2C_EEPROM_WEAR_SLOTS ? (slot) + 1 : 0)
+// byte at offset of a PARTIAL cache line has been written by master
+#define WRITTEN(l, offset) ((l)->written[(offset) >> 3] & (1 << ((offset) & 7)))
+// number of 256-byte blocks selected by device address (24C04 to 24C16)
+#if I2C_EEPROM_ADDR_BYTES == 1 && I2C_EEPROM_SIZE > 256
+#define BLOCKS (I2C_EEPROM_SIZE / 256)
+#else
+#define BLOCKS 1
+#endif
+// bytes put in Tx buffer by onRequest() while SCL is held; the rest follow I2C_TX_REFILL_LEVEL at a time
+// from onRequestMore() with the bus released, or, without I2C_TX_STREAMING, as many as Tx buffer takes
+#if defined(I2C_TX_STREAMING)
+#define FIRST_BLOCK 2
+#else
+#define FIRST_BLOCK I2C_TX_BUFFER_LENGTH
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Constructor
+//
+i2c_eepromS::i2c_eepromS()
+{
+    e = &eepromData;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Find cache line of page
+// return: cache line, or NULL if page is not cached
+//
+static struct i2cEepromLine* i2c_eeprom_line(struct i2cEepromStruct* e, uint16_t page)
+{
+    for (uint8_t i = 0; i < I2C_EEPROM_CACHE_PAGES; i++) {
+        if ((e->line[i].state & I2C_EEPROM_VALID) && e->line[i].page == page) {
+            return &e->line[i];
+        }
+    }
+    return (struct i2cEepromLine*)NULL;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Find a cache line free to (re)use - i.e. neither dirty nor being committed
+// return: cache line, or NULL if all lines are waiting to be committed
+//
+static struct i2cEepromLine* i2c_eeprom_free_line(struct i2cEepromStruct* e)
+{
+    for (uint8_t i = 0; i < I2C_EEPROM_CACHE_PAGES; i++) {
+        if (!(e->line[i].state & (I2C_EEPROM_DIRTY | I2C_EEPROM_BUSY))) {
+            return &e->line[i];
+        }
+    }
+    return (struct i2cEepromLine*)NULL;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Read - returns the byte at address of the emulated device
+//
+uint8_t i2c_eepromS::read_(struct i2cEepromStruct* e, uint16_t address)
+{
+    uint16_t page = address / I2C_EEPROM_PAGE_LENGTH;
+    struct i2cEepromLine* l = i2c_eeprom_line(e, page);
+
+    uint8_t offset = address & (I2C_EEPROM_PAGE_LENGTH - 1);
+
+    if (l != NULL && (!(l->state & I2C_EEPROM_PARTIAL) || WRITTEN(l, offset))) return l->data[offset];
+    return eeprom_read_byte(RECORD_ADDR(page, e->slot[page]) + offset);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Cached - checks if the byte at address is read from the cache, without internal EEPROM
+//
+static boolean i2c_eeprom_cached(struct i2cEepromStruct* e, uint16_t address)
+{
+    struct i2cEepromLine* l = i2c_eeprom_line(e, address / I2C_EEPROM_PAGE_LENGTH);
+
+    return (l != NULL && (!(l->state & I2C_EEPROM_PARTIAL) || WRITTEN(l, address & (I2C_EEPROM_PAGE_LENGTH - 1))));
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Word address - reads the word address written by master from Rx buffer
+//
+static uint16_t i2c_eeprom_address(struct i2cEepromStruct* e)
+{
+    uint16_t address = Wire.readByte();
+#if I2C_EEPROM_ADDR_BYTES == 2
+    address = (address << 8) | Wire.readByte();
+#else
+    address |= ((uint16_t)e->block << 8);
+#endif
+    return address & (I2C_EEPROM_SIZE - 1);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Handlers - called from the Wire interrupt routine
+//
+
+// End of read - the address counter goes on from the last byte sent, stepping back over the bytes put in
+//               Tx buffer but not sent
+static void i2c_eeprom_end_read(struct i2cEepromStruct* e)
+{
+    e->pointer = (e->fillPointer - (i2c_tx_index_t)(e->filled - Wire.getTransmitBytes())) & (I2C_EEPROM_SIZE - 1);
+}
+
+static boolean i2c_eeprom_on_addr_receive(uint16_t address, uint8_t startCount)
+{
+    struct i2cEepromStruct* e = VirtualEEPROM.e;
+
+    if (startCount > 0 && !e->writing) {
+        i2c_eeprom_end_read(e); // a read ended by repeated START; Tx buffer is not reset yet
+    }
+    e->block = (address >> 1) & (BLOCKS - 1);
+    if ((address & 1)) {
+        uint16_t pointer = e->pointer;
+        // a read after repeated START takes the word address only if it follows a write phase;
+        // otherwise Rx buffer holds the bytes of an earlier transaction
+        if (startCount > 0 && e->writing && Wire.available() >= I2C_EEPROM_ADDR_BYTES) {
+            pointer = i2c_eeprom_address(e); // random read
+        }
+        if (!eeprom_is_ready() && !i2c_eeprom_cached(e, pointer)) {
+            return false; // internal EEPROM write cycle in progress; the master is to retry (ACK polling)
+        }
+        e->pointer = pointer;
+    } else if (startCount == 0 && i2c_eeprom_free_line(e) == NULL) {
+        return false; // write-back cache is full; the master is to retry (ACK polling)
+    }
+    e->writing = !(address & 1);
+    return true;
+}
+
+static void i2c_eeprom_on_receive(size_t numBytes)
+{
+    struct i2cEepromStruct* e = VirtualEEPROM.e;
+
+    if (Wire.available() < I2C_EEPROM_ADDR_BYTES) return;
+    uint16_t address = i2c_eeprom_address(e);
+    if (Wire.available()) {
+        // Byte write or page write
+        uint16_t page = address / I2C_EEPROM_PAGE_LENGTH;
+        uint8_t offset = address & (I2C_EEPROM_PAGE_LENGTH - 1);
+        struct i2cEepromLine* l = i2c_eeprom_line(e, page);
+        if (l == NULL) {
+            l = i2c_eeprom_free_line(e);
+            if (l == NULL) return; // can't happen; the address was NACKed
+            l->page = page;
+            if (eeprom_is_ready()) {
+                eeprom_read_block(l->data, RECORD_ADDR(page, e->slot[page]), I2C_EEPROM_PAGE_LENGTH);
+                l->state = I2C_EEPROM_VALID;
+            } else {
+                memset(l->written, 0, sizeof(l->written)); // the page is read by poll() later
+                l->state = I2C_EEPROM_VALID | I2C_EEPROM_PARTIAL;
+            }
+        }
+        while (Wire.available()) {
+            l->data[offset] = Wire.readByte();
+            l->written[offset >> 3] |= (1 << (offset & 7));
+            offset = (offset + 1) & (I2C_EEPROM_PAGE_LENGTH - 1); // roll over within the page
+        }
+        l->state |= I2C_EEPROM_DIRTY;
+        address = page * I2C_EEPROM_PAGE_LENGTH + offset;
+    }
+    e->pointer = address;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Fill Tx buffer - puts up to count bytes from the fill pointer in Tx buffer; stops at a byte not cached
+//                 while internal EEPROM is being written
+//
+static void i2c_eeprom_fill(struct i2cEepromStruct* e, i2c_tx_index_t count)
+{
+    while (count--) {
+        if (!eeprom_is_ready() && !i2c_eeprom_cached(e, e->fillPointer)) break;
+        if (!Wire.write(VirtualEEPROM.read(e->fillPointer))) break;
+        e->fillPointer = (e->fillPointer + 1) & (I2C_EEPROM_SIZE - 1);
+        e->filled++;
+    }
+}
+
+#if defined(I2C_TX_STREAMING)
+static void i2c_eeprom_on_request_more(void)
+{
+    i2c_eeprom_fill(VirtualEEPROM.e, I2C_TX_REFILL_LEVEL);
+}
+#endif
+
+static void i2c_eeprom_on_request(void)
+{
+    struct i2cEepromStruct* e = VirtualEEPROM.e;
+
+    e->fillPointer = e->pointer;
+    e->filled = 0;
+    i2c_eeprom_fill(e, FIRST_BLOCK);
+}
+
+static void i2c_eeprom_on_stop(void)
+{
+    i2c_eeprom_end_read(VirtualEEPROM.e);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Initialize - finds the current wear slot of each page, then starts Wire as the emulated EEPROM
+// parameters:
+//      address = 7bit slave address of device
+//
+void i2c_eepromS::begin_(struct i2cEepromStruct* e, uint8_t address)
+{
+    for (uint16_t page = 0; page < I2C_EEPROM_PAGES; page++) {
+        uint8_t slot = 0;
+#if I2C_EEPROM_WEAR_SLOTS > 1
+        uint8_t seq = eeprom_read_byte(RECORD_ADDR(page, 0) + I2C_EEPROM_PAGE_LENGTH);
+        for (uint8_t next = 1; next < I2C_EEPROM_WEAR_SLOTS; next++) {
+            uint8_t nextSeq = eeprom_read_byte(RECORD_ADDR(page, next) + I2C_EEPROM_PAGE_LENGTH);
+            if (nextSeq != (uint8_t)(seq + 1)) break;
+            slot = next;
+            seq = nextSeq;
+        }
+#endif
+        e->slot[page] = slot;
+    }
+    for (uint8_t i = 0; i < I2C_EEPROM_CACHE_PAGES; i++) {
+        e->line[i].state = 0;
+    }
+    e->pointer = 0;
+    e->commitLine = -1;
+    Wire.onAddrReceive(i2c_eeprom_on_addr_receive);
+    Wire.onReceive(i2c_eeprom_on_receive);
+    Wire.onRequest(i2c_eeprom_on_request);
+#if defined(I2C_TX_STREAMING)
+    Wire.onRequestMore(i2c_eeprom_on_request_more);
+#endif
+    Wire.onStop(i2c_eeprom_on_stop);
+    Wire.begin(address, (BLOCKS - 1) << 1); // block select bits are don't care
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Poll - writes at most one byte of the write-back cache to internal EEPROM, only if it is ready
+//
+void i2c_eepromS::poll_(struct i2cEepromStruct* e)
+{
+    uint8_t sreg = SREG;
+    struct i2cEepromLine* l;
+
+    if (!eeprom_is_ready()) return;
+    if (e->commitLine < 0) {
+        // pick a dirty line
+        uint8_t i;
+        for (i = 0; i < I2C_EEPROM_CACHE_PAGES; i++) {
+            if ((e->line[i].state & I2C_EEPROM_DIRTY)) break;
+        }
+        if (i == I2C_EEPROM_CACHE_PAGES) return;
+        l = &e->line[i];
+        if ((l->state & I2C_EEPROM_PARTIAL)) {
+            // fill in the bytes master has not written; EEPROM is ready, so this does not wait
+            cli();
+            uint8_t* current = RECORD_ADDR(l->page, e->slot[l->page]);
+            for (uint8_t j = 0; j < I2C_EEPROM_PAGE_LENGTH; j++) {
+                if (!WRITTEN(l, j)) l->data[j] = eeprom_read_byte(current + j);
+            }
+            l->state &= ~I2C_EEPROM_PARTIAL;
+            SREG = sreg;
+        }
+        // commit a copy, so that a master write to the page meanwhile can't make a mixed record;
+        // the line is kept (BUSY) and dirtied again by such a write
+        cli();
+        memcpy(e->commitData, l->data, I2C_EEPROM_PAGE_LENGTH);
+        l->state = (l->state & ~I2C_EEPROM_DIRTY) | I2C_EEPROM_BUSY;
+        SREG = sreg;
+        uint8_t* current = RECORD_ADDR(l->page, e->slot[l->page]);
+        uint8_t j;
+        for (j = 0; j < I2C_EEPROM_PAGE_LENGTH; j++) {
+            if (eeprom_read_byte(current + j) != e->commitData[j]) break;
+        }
+        if (j == I2C_EEPROM_PAGE_LENGTH) {
+            // unchanged; save a write cycle
+            cli();
+            l->state &= ~I2C_EEPROM_BUSY;
+            SREG = sreg;
+            return;
+        }
+        e->commitLine = i;
+        e->commitSlot = NEXT_SLOT(e->slot[l->page]);
+        e->commitSeq = eeprom_read_byte(current + I2C_EEPROM_PAGE_LENGTH) + 1;
+        e->commitIndex = 0;
+    }
+    l = &e->line[e->commitLine];
+    uint8_t* record = RECORD_ADDR(l->page, e->commitSlot);
+    // the interrupt routine reads EEPROM within a transaction; start a write only outside of any, and keep
+    // an address match from coming in before EEPROM turns busy (it is NACKed while EEPROM is busy)
+    cli();
+    if (Wire.i2c->startCount >= 0) {
+        SREG = sreg;
+        return;
+    }
+    if (e->commitIndex < I2C_EEPROM_PAGE_LENGTH) {
+        eeprom_write_byte(record + e->commitIndex, e->commitData[e->commitIndex]);
+        e->commitIndex++;
+        SREG = sreg;
+        return;
+    }
+    eeprom_write_byte(record + I2C_EEPROM_PAGE_LENGTH, e->commitSeq); // sequence number last
+    e->slot[l->page] = e->commitSlot;
+    l->state &= ~I2C_EEPROM_BUSY;
+    SREG = sreg;
+    e->commitLine = -1;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Dirty - returns true if some data is not committed yet
+//
+boolean i2c_eepromS::dirty_(struct i2cEepromStruct* e)
+{
+    for (uint8_t i = 0; i < I2C_EEPROM_CACHE_PAGES; i++) {
+        if ((e->line[i].state & (I2C_EEPROM_DIRTY | I2C_EEPROM_BUSY))) return true;
+    }
+    return false;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Flush - commits all of the write-back cache and waits for completion
+//
+void i2c_eepromS::flush_(struct i2cEepromStruct* e)
+{
+    while (dirty_(e)) {
+        poll_(e);
+    }
+    eeprom_busy_wait();
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Instantiate
+//
+i2c_eepromS VirtualEEPROM = i2c_eepromS();
+
+#endif
@@ -0,0 +1,205 @@
+/*
+    WireS_EEPROM - I2C serial EEPROM emulator built on WireS
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "WireS.h"
+
+#if !defined(WIRE_S_EEPROM_H) && defined(WIRE_S_H) && defined(I2C_EEPROM_EMULATOR)
+#define WIRE_S_EEPROM_H
+
+#include <avr/eeprom.h>
+
+// ======================================================================================================
+// == Start User Define Section =========================================================================
+// ======================================================================================================
+
+// ------------------------------------------------------------------------------------------------------
+// Device size - number of bytes emulated (power of two), e.g. 128 for 24C01, 256 for 24C02,
+//               4096 for 24C32.  The pages (and their wear slots) must fit in internal EEPROM, which is
+//               256 bytes on ATtiny441/828/1634 and 512 bytes on ATtiny841.
+//
+#define I2C_EEPROM_SIZE 128
+
+// ------------------------------------------------------------------------------------------------------
+// Word address bytes - 1 for 24C01 to 24C16 (24C04 to 24C16 take the upper address bits from the
+//                      device address), 2 for 24C32 to 24C512.
+//
+#define I2C_EEPROM_ADDR_BYTES 1
+
+// ------------------------------------------------------------------------------------------------------
+// Page length - page write size of the emulated device (power of two), e.g. 8 for 24C01/02,
+//               32 for 24C32, 64 for 24C256.  A page write must fit in Rx buffer of WireS.
+//
+#define I2C_EEPROM_PAGE_LENGTH 8
+
+// ------------------------------------------------------------------------------------------------------
+// Cache pages - number of pages held in the RAM write-back cache.  A master write is NACKed, as a real
+//               EEPROM does during its write cycle, while all of them are waiting to be committed.
+//
+#define I2C_EEPROM_CACHE_PAGES 4
+
+// ------------------------------------------------------------------------------------------------------
+// Wear slots - number of internal EEPROM copies each page rotates through on commit (1 to disable
+//              wear leveling).  The endurance of each page is multiplied by this number.  As many as fit
+//              in internal EEPROM by default, e.g. 1 for 24C01 on ATtiny441 and 3 on ATtiny841.
+//
+#define I2C_EEPROM_WEAR_SLOTS ((E2END + 1 - I2C_EEPROM_OFFSET) / (I2C_EEPROM_PAGES * I2C_EEPROM_RECORD))
+
+// ------------------------------------------------------------------------------------------------------
+// Offset - start address of the emulated device in internal EEPROM
+//
+#define I2C_EEPROM_OFFSET 0
+
+// ======================================================================================================
+// == End User Define Section ===========================================================================
+// ======================================================================================================
+
+#if !defined(E2END) || !E2END
+    #error "WireS_EEPROM needs internal EEPROM"
+#endif
+#define I2C_EEPROM_PAGES  (I2C_EEPROM_SIZE / I2C_EEPROM_PAGE_LENGTH)
+#define I2C_EEPROM_RECORD (I2C_EEPROM_PAGE_LENGTH + 1) // page data followed by sequence number
+
+#if (I2C_EEPROM_SIZE & (I2C_EEPROM_SIZE - 1)) || (I2C_EEPROM_PAGE_LENGTH & (I2C_EEPROM_PAGE_LENGTH - 1))
+    #error "I2C_EEPROM_SIZE and I2C_EEPROM_PAGE_LENGTH must be powers of two"
+#endif
+#if (I2C_EEPROM_PAGE_LENGTH > I2C_EEPROM_SIZE) || (I2C_EEPROM_PAGE_LENGTH > 128)
+    #error "I2C_EEPROM_PAGE_LENGTH is too large"
+#endif
+#if (I2C_EEPROM_ADDR_BYTES < 1) || (I2C_EEPROM_ADDR_BYTES > 2) || (I2C_EEPROM_ADDR_BYTES == 1 && I2C_EEPROM_SIZE > 2048)
+    #error "I2C_EEPROM_ADDR_BYTES must be 1 (up to 2048 bytes) or 2"
+#endif
+#if (I2C_EEPROM_WEAR_SLOTS < 1) || (I2C_EEPROM_WEAR_SLOTS > 255)
+    #error "I2C_EEPROM_WEAR_SLOTS must be 1 to 255; for 0 the pages do not fit in internal EEPROM"
+#endif
+#if (I2C_EEPROM_ADDR_BYTES + I2C_EEPROM_PAGE_LENGTH > I2C_RX_BUFFER_LENGTH)
+    #error "I2C_RX_BUFFER_LENGTH is too small for a page write"
+#endif
+#if defined(I2C_STATIC_ON_ADDR_RECEIVE) || defined(I2C_STATIC_ON_RECEIVE) || defined(I2C_STATIC_ON_REQUEST) \
+    || defined(I2C_STATIC_ON_REQUEST_MORE) || defined(I2C_STATIC_ON_STOP)
+    #error "WireS_EEPROM registers its own handlers; do not bind them statically"
+#endif
+
+#if (I2C_EEPROM_OFFSET + I2C_EEPROM_PAGES * I2C_EEPROM_WEAR_SLOTS * I2C_EEPROM_RECORD > E2END + 1)
+    #error "I2C_EEPROM_SIZE x I2C_EEPROM_WEAR_SLOTS does not fit in internal EEPROM"
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Cache line
+//
+#define I2C_EEPROM_VALID 0x01 // holds a page
+#define I2C_EEPROM_DIRTY 0x02 // written by master and not committed yet
+#define I2C_EEPROM_BUSY  0x04 // being committed (from a copy; master may write it meanwhile)
+#define I2C_EEPROM_PARTIAL 0x08 // holds only the bytes marked in written; filled in from internal EEPROM by poll()
+
+struct i2cEepromLine
+{
+    volatile uint8_t  state;                       // I2C_EEPROM_xxx flags              (User&ISR)
+    uint16_t          page;                        // page number                       (ISR)
+    uint8_t           data[I2C_EEPROM_PAGE_LENGTH]; // page data                        (User&ISR)
+    uint8_t           written[(I2C_EEPROM_PAGE_LENGTH + 7) / 8]; // bytes written while PARTIAL (User&ISR)
+};
+
+// ------------------------------------------------------------------------------------------------------
+// EEPROM emulator data structure
+//
+struct i2cEepromStruct
+{
+    struct i2cEepromLine line[I2C_EEPROM_CACHE_PAGES]; // Write-back Cache          (User&ISR)
+    volatile uint8_t  slot[I2C_EEPROM_PAGES];     // current wear slot of each page (User&ISR)
+    volatile uint16_t pointer;                    // internal address counter       (ISR)
+    uint16_t          fillPointer;                // next address to put in Tx buffer (ISR)
+    i2c_tx_index_t    filled;                     // bytes put in Tx buffer         (ISR)
+    uint8_t           block;                      // block select bits of device address (ISR)
+    boolean           writing;                    // last address was for a master write (ISR)
+    int8_t            commitLine;                 // cache line being committed, -1 if none (User)
+    uint8_t           commitSlot;                 // wear slot being written        (User)
+    uint8_t           commitSeq;                  // sequence number being written  (User)
+    uint8_t           commitIndex;                // next byte to write             (User)
+    uint8_t           commitData[I2C_EEPROM_PAGE_LENGTH]; // copy of the page being written (User)
+};
+
+class i2c_eepromS
+{
+private:
+    static struct i2cEepromStruct eepromData;
+
+public:
+    //
+    // Data structure pointer - passed as an argument to base functions
+    //
+    struct i2cEepromStruct* e;
+
+    // ------------------------------------------------------------------------------------------------------
+    // Constructor
+    //
+    i2c_eepromS();
+
+    // ------------------------------------------------------------------------------------------------------
+    // Initialize (base routine)
+    //
+    static void begin_(struct i2cEepromStruct* e, uint8_t address);
+    //
+    // Initialize - starts Wire as the emulated EEPROM and registers its handlers
+    // return: none
+    // parameters:
+    //      address = 7bit slave address of device (0x50 for most serial EEPROMs); the block select bits
+    //                of 24C04 to 24C16 are don't care
+    //
+    inline void begin(uint8_t address = 0x50) { begin_(e, address); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Poll (base routine)
+    //
+    static void poll_(struct i2cEepromStruct* e);
+    //
+    // Poll - commits the write-back cache to internal EEPROM in background; call this from loop().
+    //        At most one byte is written per call, only when EEPROM is ready and no transaction is in
+    //        progress, so it never blocks nor keeps the interrupt routine waiting for EEPROM.
+    // return: none
+    //
+    inline void poll(void) { poll_(e); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Flush (base routine)
+    //
+    static void flush_(struct i2cEepromStruct* e);
+    //
+    // Flush - commits all of the write-back cache and waits for it to complete (e.g. before sleep)
+    // return: none
+    //
+    inline void flush(void) { flush_(e); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Dirty - returns true if some data written by master is not committed to internal EEPROM yet
+    //
+    static boolean dirty_(struct i2cEepromStruct* e);
+    inline boolean dirty(void) { return dirty_(e); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Read (base routine)
+    //
+    static uint8_t read_(struct i2cEepromStruct* e, uint16_t address);
+    //
+    // Read - returns the byte at address of the emulated device (from the cache if it is there)
+    //
+    inline uint8_t read(uint16_t address) { return read_(e, address); }
+};
+
+extern i2c_eepromS VirtualEEPROM;
+
+#endif // WIRE_S_EEPROM_H
@@ -0,0 +1,228 @@
+/*
+    WireS_Update - firmware image receiver over I2C built on WireS
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// A master streams an image in a single write of any length:
+//   START(address) / DATA(bytes...) / END(crc), then reads the status until it is no longer BUSY.
+// A command write ends at STOP or at a repeated START.
+//
+// The image bytes are taken by the onReceiveChunk() handler, which runs with the bus released while the
+// ISR goes on receiving into the other half of Rx buffer.  So block N is erased and written by SPM while
+// block N+1 is coming in, and SCL is stretched only while SPM halts the CPU.  Blocks already holding the
+// same data are not reprogrammed.  A block is a page, or four pages on the parts whose page erase clears
+// four pages at once (see I2C_UPDATE_BLOCK).
+//
+// The blocks are programmed in the handler, that is in interrupt context, and loop() is stopped for the
+// erase and writes of each block (some 20 ms on ATtiny841).  This is on purpose: only a running handler
+// makes the ISR hold SCL when the other half fills too, so a block left to poll() would have nothing to
+// pace the master by, and the next block would overwrite it.  Only the last partial block is left to poll().
+//
+// The image is only staged.  Nothing here copies it over the running sketch or jumps to it; that is for a
+// bootloader of the application's own (ATtiny441/841 and ATtiny1634 have no boot section to protect one).
+
+#include "WireS_Update.h"
+
+#if defined(WIRE_S_UPDATE_H)
+
+#include <avr/io.h>
+#include <avr/boot.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+struct i2cUpdateStruct i2c_updateS::updateData;
+
+// ------------------------------------------------------------------------------------------------------
+// Constructor
+//
+i2c_updateS::i2c_updateS()
+{
+    u = &updateData;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Program the assembled block to flash - one erase, then each page of the block is filled and written
+//
+static void i2c_update_program(struct i2cUpdateStruct* u)
+{
+    uint8_t sreg = SREG;
+    uint8_t i;
+
+    if (u->address >= I2C_UPDATE_END) {
+        u->status = I2C_UPDATE_ERROR_RANGE;
+        return;
+    }
+    for (i = 0; i < I2C_UPDATE_BLOCK; i++) {
+        if (pgm_read_byte(u->address + i) != u->block[i]) break;
+    }
+    if (i < I2C_UPDATE_BLOCK) {
+        // each SPM must follow its SPMCSR setting within four cycles; keep the ISR off in between
+        cli();
+        boot_page_erase(u->address);
+        SREG = sreg;
+        boot_spm_busy_wait();
+        for (uint16_t page = 0; page < I2C_UPDATE_BLOCK; page += SPM_PAGESIZE) {
+            for (i = 0; i < SPM_PAGESIZE; i += 2) {
+                cli();
+                boot_page_fill(u->address + page + i, u->block[page + i] | (u->block[page + i + 1] << 8));
+                SREG = sreg;
+            }
+            cli();
+            boot_page_write(u->address + page);
+            SREG = sreg;
+            boot_spm_busy_wait();
+        }
+    }
+    u->address += I2C_UPDATE_BLOCK;
+    u->blockLength = 0;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// End of write - carries out the command of the master write just ended
+//
+static void i2c_update_end_write(struct i2cUpdateStruct* u)
+{
+    uint16_t arg = u->arg[0] | (u->arg[1] << 8);
+
+    switch (u->command) {
+    case 0:
+    case I2C_UPDATE_CMD_DATA:
+        break;
+    case I2C_UPDATE_CMD_START:
+        if (u->argLength < 2) {
+            u->status = I2C_UPDATE_ERROR_COMMAND;
+        } else if ((arg % I2C_UPDATE_BLOCK) || arg < I2C_UPDATE_START || arg >= I2C_UPDATE_END) {
+            u->status = I2C_UPDATE_ERROR_RANGE;
+        } else {
+            u->start = u->address = arg;
+            u->length = 0;
+            u->blockLength = 0;
+            u->status = I2C_UPDATE_RECEIVING;
+        }
+        break;
+    case I2C_UPDATE_CMD_END:
+        if (u->argLength < 2 || u->status != I2C_UPDATE_RECEIVING) {
+            u->status = I2C_UPDATE_ERROR_COMMAND;
+        } else {
+            u->crc = arg;
+            u->status = I2C_UPDATE_BUSY; // poll() finishes
+        }
+        break;
+    default:
+        u->status = I2C_UPDATE_ERROR_COMMAND;
+        break;
+    }
+    u->command = 0;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Handlers - called from the Wire interrupt routine
+//
+static boolean i2c_update_on_addr_receive(uint16_t address, uint8_t startCount)
+{
+    struct i2cUpdateStruct* u = FirmwareUpdate.u;
+
+    if (startCount > 0) {
+        i2c_update_end_write(u); // a command write ended by repeated START; onReceive() comes only at STOP
+    }
+    if (!(address & 1)) {
+        if (u->status == I2C_UPDATE_BUSY) {
+            return false; // verifying; the master is to retry (ACK polling)
+        }
+        u->command = 0;
+    }
+    return true;
+}
+
+static void i2c_update_on_receive_chunk(const uint8_t* data, size_t length)
+{
+    struct i2cUpdateStruct* u = FirmwareUpdate.u;
+
+    while (length--) {
+        uint8_t b = *data++;
+        if (u->command == 0) {
+            u->command = b;
+            u->argLength = 0;
+        } else if (u->command == I2C_UPDATE_CMD_DATA) {
+            if (u->status != I2C_UPDATE_RECEIVING) continue;
+            u->block[u->blockLength++] = b;
+            u->length++;
+            if (u->blockLength == I2C_UPDATE_BLOCK) {
+                i2c_update_program(u);
+            }
+        } else if (u->argLength < sizeof(u->arg)) {
+            u->arg[u->argLength++] = b;
+        }
+    }
+}
+
+static void i2c_update_on_receive(size_t numBytes)
+{
+    i2c_update_end_write(FirmwareUpdate.u);
+}
+
+static void i2c_update_on_request(void)
+{
+    struct i2cUpdateStruct* u = FirmwareUpdate.u;
+
+    Wire.write(u->status);
+    Wire.write(lowByte(u->length));
+    Wire.write(highByte(u->length));
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Initialize - starts Wire as the firmware update target
+// parameters:
+//      address = 7bit slave address of device
+//
+void i2c_updateS::begin_(struct i2cUpdateStruct* u, uint8_t address)
+{
+    u->status = I2C_UPDATE_IDLE;
+    u->command = 0;
+    Wire.onAddrReceive(i2c_update_on_addr_receive);
+    Wire.onReceiveChunk(i2c_update_on_receive_chunk);
+    Wire.onReceive(i2c_update_on_receive);
+    Wire.onRequest(i2c_update_on_request);
+    Wire.begin(address);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Poll - after END, programs the last partial block (padded with 0xFF) and verifies the image in flash
+//
+void i2c_updateS::poll_(struct i2cUpdateStruct* u)
+{
+    if (u->status != I2C_UPDATE_BUSY) return; // master writes are NACKed while BUSY
+    if (u->blockLength) {
+        for (uint8_t i = u->blockLength; i < I2C_UPDATE_BLOCK; i++) {
+            u->block[i] = 0xFF;
+        }
+        i2c_update_program(u);
+        if (u->status != I2C_UPDATE_BUSY) return;
+    }
+    uint16_t crc = 0;
+    for (uint16_t i = 0; i < u->length; i++) {
+        crc = _crc_xmodem_update(crc, pgm_read_byte(u->start + i));
+    }
+    u->status = (crc == u->crc ? I2C_UPDATE_DONE : I2C_UPDATE_ERROR_CRC);
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Instantiate
+//
+i2c_updateS FirmwareUpdate = i2c_updateS();
+
+#endif
@@ -0,0 +1,151 @@
+/*
+    WireS_Update - firmware image receiver over I2C built on WireS
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#include "WireS.h"
+
+#if !defined(WIRE_S_UPDATE_H) && defined(WIRE_S_H) && defined(I2C_FIRMWARE_UPDATE)
+#define WIRE_S_UPDATE_H
+
+#include <avr/io.h>
+
+// ======================================================================================================
+// == Start User Define Section =========================================================================
+// ======================================================================================================
+
+// ------------------------------------------------------------------------------------------------------
+// Update region - flash byte addresses from I2C_UPDATE_START up to (not including) I2C_UPDATE_END that
+//                 a master may program; both must be multiples of I2C_UPDATE_BLOCK.  The upper half of
+//                 flash by default, where the new image is staged for a bootloader to install.
+//
+#define I2C_UPDATE_START ((FLASHEND + 1) / 2)
+#define I2C_UPDATE_END   (FLASHEND + 1)
+
+// ======================================================================================================
+// == End User Define Section ===========================================================================
+// ======================================================================================================
+
+#if defined(__AVR_TINY__)
+    #error "WireS_Update needs self-programming by SPM, which ATtiny20/40 don't have"
+#endif
+#if !defined(I2C_RX_STREAMING) || defined(I2C_STATIC_ON_ADDR_RECEIVE) || defined(I2C_STATIC_ON_RECEIVE) \
+    || defined(I2C_STATIC_ON_RECEIVE_CHUNK) || defined(I2C_STATIC_ON_REQUEST)
+    #error "WireS_Update needs I2C_RX_STREAMING and registers its own handlers; do not bind them statically"
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Erase block - a page erase of ATtiny441/841 and ATtiny1634 clears four pages at once, so the image is
+//               assembled and programmed in blocks of that size: erased once, then written page by page
+//
+#if defined(__AVR_ATtiny441__) || defined(__AVR_ATtiny841__) || defined(__AVR_ATtiny1634__)
+#define I2C_UPDATE_ERASE_PAGES 4
+#else
+#define I2C_UPDATE_ERASE_PAGES 1
+#endif
+#define I2C_UPDATE_BLOCK (SPM_PAGESIZE * I2C_UPDATE_ERASE_PAGES)
+
+#if (I2C_UPDATE_START % I2C_UPDATE_BLOCK) || (I2C_UPDATE_END % I2C_UPDATE_BLOCK) || (I2C_UPDATE_END > FLASHEND + 1)
+    #error "I2C_UPDATE_START and I2C_UPDATE_END must be erase block aligned addresses in flash"
+#endif
+
+// ------------------------------------------------------------------------------------------------------
+// Commands - the first byte of a master write
+//
+#define I2C_UPDATE_CMD_START 0x01 // + address (2 bytes, LSB first): start an image at flash address
+#define I2C_UPDATE_CMD_DATA  0x02 // + any number of image bytes
+#define I2C_UPDATE_CMD_END   0x03 // + CRC-16/XMODEM of the image (2 bytes, LSB first): finish and verify
+
+// ------------------------------------------------------------------------------------------------------
+// Status - the first byte of a master read (followed by the number of image bytes received, LSB first)
+//
+#define I2C_UPDATE_IDLE          0x00
+#define I2C_UPDATE_RECEIVING     0x01 // START accepted; DATA is being programmed
+#define I2C_UPDATE_BUSY          0x02 // END accepted; verifying (master writes are NACKed meanwhile)
+#define I2C_UPDATE_DONE          0x03 // image verified
+#define I2C_UPDATE_ERROR_CRC     0x80 // image in flash does not match the CRC
+#define I2C_UPDATE_ERROR_RANGE   0x81 // address out of the update region or not block aligned
+#define I2C_UPDATE_ERROR_COMMAND 0x82 // unknown command or command out of sequence
+
+// ------------------------------------------------------------------------------------------------------
+// Firmware update data structure
+//
+struct i2cUpdateStruct
+{
+    uint8_t           block[I2C_UPDATE_BLOCK]; // erase block being assembled     (ISR)
+    uint8_t           blockLength;           // bytes in block                    (ISR)
+    uint16_t          start;                 // flash address of image            (ISR)
+    uint16_t          address;               // flash address of block            (ISR)
+    uint16_t          length;                // image bytes received              (User&ISR)
+    uint16_t          crc;                   // CRC sent by master                (ISR)
+    uint8_t           command;               // command of current write, 0 if none yet (ISR)
+    uint8_t           argLength;             // command argument bytes received   (ISR)
+    uint8_t           arg[2];                // command arguments                 (ISR)
+    volatile uint8_t  status;                // I2C_UPDATE_xxx                    (User&ISR)
+};
+
+class i2c_updateS
+{
+private:
+    static struct i2cUpdateStruct updateData;
+
+public:
+    //
+    // Data structure pointer - passed as an argument to base functions
+    //
+    struct i2cUpdateStruct* u;
+
+    // ------------------------------------------------------------------------------------------------------
+    // Constructor
+    //
+    i2c_updateS();
+
+    // ------------------------------------------------------------------------------------------------------
+    // Initialize (base routine)
+    //
+    static void begin_(struct i2cUpdateStruct* u, uint8_t address);
+    //
+    // Initialize - starts Wire as the firmware update target and registers its handlers
+    // return: none
+    // parameters:
+    //      address = 7bit slave address of device
+    //
+    inline void begin(uint8_t address) { begin_(u, address); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Poll (base routine)
+    //
+    static void poll_(struct i2cUpdateStruct* u);
+    //
+    // Poll - programs the last partial block and verifies the image after END; call this from loop()
+    // return: none
+    //
+    inline void poll(void) { poll_(u); }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Status - returns I2C_UPDATE_xxx
+    //
+    inline uint8_t status(void) { return u->status; }
+
+    // ------------------------------------------------------------------------------------------------------
+    // Length - returns the number of image bytes received
+    //
+    inline uint16_t length(void) { return u->length; }
+};
+
+extern i2c_updateS FirmwareUpdate;
+
+#endif // WIRE_S_UPDATE_H
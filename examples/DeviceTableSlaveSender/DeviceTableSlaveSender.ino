@@ -0,0 +1,61 @@
+// Device Table Slave Sender -- WireS library sample
+//
+// This code is derived from
+//   http://www.arduino.cc/en/Tutorial/MasterReader
+// Modified by Hisashi ITO (info at mewpro.cc) (c) 2015
+// to demonstrate how to make slave with two addresses, one virtual device
+// per address (Wire.setDevice()); the "Two Address Slave Sender" example
+// does the same with onAddrReceive() and the plain API.
+//
+// Refer to the "Two Address Master Reader" example for use with this
+
+// The original copyright follows:
+// ------------------------------------------------------------
+// Wire Slave Sender
+// by Nicholas Zambetti <http://www.zambetti.com>
+
+// Demonstrates use of the Wire library
+// Sends data as an I2C/TWI slave device
+// Refer to the "Wire Master Reader" example for use with this
+
+// Created 29 March 2006
+
+// This example code is in the public domain.
+
+#include <WireS.h>
+
+#if I2C_DEVICE_TABLE_LENGTH < 2
+#error "set I2C_DEVICE_TABLE_LENGTH in WireS.h to 2 or more"
+#endif
+
+// one virtual device per address; the interrupt routine selects the device
+// by the address so that no handler has to branch on it
+struct i2cDevice device2;
+struct i2cDevice device3;
+
+void setup()
+{
+  device2.onRequest = requestEvent2; // register event
+  device3.onRequest = requestEvent3; // register event
+  Wire.begin(2, (3 << 1 | 1));      // join i2c bus with addresses #2 and #3
+  Wire.setDevice(2, &device2);
+  Wire.setDevice(3, &device3);
+}
+
+void loop()
+{
+  delay(100);
+}
+
+// functions that execute whenever data is requested by master
+// these functions are registered as events, see setup()
+void requestEvent2()
+{
+  Wire.write("hello "); // respond with message of 6 bytes
+                        // as expected by master
+}
+
+void requestEvent3()
+{
+  Wire.write("aloha "); // respond with another message
+}
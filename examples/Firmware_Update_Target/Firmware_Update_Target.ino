@@ -0,0 +1,31 @@
+// Firmware_Update_Target -- WireS library sample
+//
+// Receives a firmware image streamed by an I2C master and stages it in the upper half of flash
+// (see I2C_UPDATE_START and I2C_UPDATE_END in WireS_Update.h).  START takes a multiple of
+// I2C_UPDATE_BLOCK (64 bytes on ATtiny441/841, 128 on ATtiny1634, 64 on ATtiny828).
+//
+// Master side (bus-pirate semantics; the image is written in a single transaction of any length):
+//   [ 0x20 0x01 addrL addrH ]          START at flash address
+//   [ 0x20 0x02 byte byte byte ... ]   DATA
+//   [ 0x20 0x03 crcL crcH ]            END with CRC-16/XMODEM of the image
+//   [ 0x21 r r r ]                     status (0x02 BUSY while verifying, 0x03 DONE) and bytes received
+//
+// This example code is in the public domain.
+
+#include <WireS.h>
+#include <WireS_Update.h>
+
+#if !defined(I2C_FIRMWARE_UPDATE)
+#error "uncomment I2C_FIRMWARE_UPDATE and I2C_RX_STREAMING in WireS.h"
+#endif
+
+void setup() {
+  FirmwareUpdate.begin(0x10);
+}
+
+void loop() {
+  FirmwareUpdate.poll();
+  if (FirmwareUpdate.status() == I2C_UPDATE_DONE) {
+    // the new image is verified; the library has no install step, so hand it over to a bootloader here
+  }
+}
@@ -0,0 +1,192 @@
+// ISR Benchmark Master -- WireS library sample
+//
+// (c) 2015 Hisashi ITO (info at mewpro.cc)
+//
+// Refer to the "ISR Benchmark Slave" example for use with this.
+// THIS CODE IS FOR ARDUINO UNO or ARDUINO w/ ATmega CORE
+// Upload the code to Arduino Uno (or similar), connect four pins SDA, SCL, GND, VCC to ATtiny,
+// and open the serial monitor at 115200 baud.
+//
+// Replays each traffic pattern at 100kHz, 400kHz, and 1MHz (as far as the master reaches) and prints
+// one CSV line per run:
+//   pattern, SCL Hz, transactions, bytes, elapsed us, throughput bytes/s, bus idle share %,
+//   ISR calls, ISR cycles per byte, ISR cycles per transaction, worst ISR cycles, worst stretch us
+// "bus idle share" compares the elapsed time with the bare bus time (9 clocks per byte and address,
+// plus START/STOP) and includes the master's own overhead.  The worst ISR time is an upper bound
+// of the SCL stretch by the slave, since SCL is held while the ISR runs.  The write of the statistics
+// register adds one transaction and one byte to the slave side counts.
+//
+// Save the output as a baseline and compare it after changing WireS.cpp or the handlers; the
+// numbers depend only on the slave configuration, its clock, and the master.
+
+#include <Wire.h>
+
+#define SLAVE_ADDRESS   0x20
+#define SLAVE_F_CPU     8000000UL // clock of the ATtiny
+#define REG_STATS       0xFF      // I2C_STATS_REGISTER of the slave
+#define CMD_CLEAR_STATS 0xFE
+#define REPEAT          50        // transactions (or repeated STARTs) per run
+
+struct stats_t {                  // struct i2cStats of the slave, LSB first
+  uint16_t transactions, repeatedStarts, rxBytes, txBytes, nacks, overruns, underruns;
+  uint16_t busErrors, collisions, interrupts, isrMax;
+  uint32_t isrTotal;
+};
+
+uint32_t busBits;                 // bit times on the bus in the current run
+uint16_t busBytes;                // data bytes in the current run
+
+void clearStats()
+{
+  Wire.beginTransmission(SLAVE_ADDRESS);
+  Wire.write(CMD_CLEAR_STATS);
+  Wire.endTransmission();
+}
+
+boolean readStats(struct stats_t* s)
+{
+  uint8_t* p = (uint8_t*)s;
+  Wire.beginTransmission(SLAVE_ADDRESS);
+  Wire.write(REG_STATS);
+  Wire.endTransmission(false);
+  if (Wire.requestFrom(SLAVE_ADDRESS, (int)sizeof(*s)) != sizeof(*s)) return false;
+  for (uint8_t i = 0; i < sizeof(*s); i++) {
+    p[i] = Wire.read(); // AVR is little endian too
+  }
+  return true;
+}
+
+// address byte + n data bytes, with START (or repeated START)
+void account(uint8_t n)
+{
+  busBits += 1 + 9 * (1 + n);
+  busBytes += n;
+}
+
+// EEPROM sequential read: set pointer, then read a full master buffer after repeated START
+void sequentialRead()
+{
+  for (uint8_t i = 0; i < REPEAT; i++) {
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(0);
+    Wire.endTransmission(false);
+    Wire.requestFrom(SLAVE_ADDRESS, 32);
+    while (Wire.available()) Wire.read();
+    account(1);
+    account(32);
+    busBits += 1; // STOP
+  }
+}
+
+// register polling: set pointer, read a 16-bit register
+void registerPolling()
+{
+  for (uint8_t i = 0; i < REPEAT; i++) {
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(2);
+    Wire.endTransmission(false);
+    Wire.requestFrom(SLAVE_ADDRESS, 2);
+    while (Wire.available()) Wire.read();
+    account(1);
+    account(2);
+    busBits += 1;
+  }
+}
+
+// large write: pointer followed by as many bytes as the master buffer holds
+void largeWrite()
+{
+  for (uint8_t i = 0; i < REPEAT; i++) {
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(0);
+    for (uint8_t n = 0; n < 31; n++) Wire.write(n);
+    Wire.endTransmission();
+    account(32);
+    busBits += 1;
+  }
+}
+
+// repeated START storm: one transaction of many short write/read pairs without STOP
+void repeatedStartStorm()
+{
+  for (uint8_t i = 0; i < REPEAT; i++) {
+    Wire.beginTransmission(SLAVE_ADDRESS);
+    Wire.write(i & 0x7F);
+    Wire.endTransmission(false);
+    Wire.requestFrom(SLAVE_ADDRESS, 1, (int)(i == REPEAT - 1)); // STOP only at the end
+    while (Wire.available()) Wire.read();
+    account(1);
+    account(1);
+  }
+  busBits += 1;
+}
+
+struct pattern_t {
+  const char* name;
+  void (*run)(void);
+} patterns[] = {
+  { "sequential_read", sequentialRead },
+  { "register_polling", registerPolling },
+  { "large_write", largeWrite },
+  { "repeated_start_storm", repeatedStartStorm },
+};
+
+const uint32_t clocks[] = { 100000, 400000, 1000000 };
+
+void benchmark(const struct pattern_t* pattern, uint32_t clock)
+{
+  struct stats_t s;
+
+  Wire.setClock(clock);
+  clearStats();
+  busBits = 0;
+  busBytes = 0;
+  uint32_t start = micros();
+  pattern->run();
+  uint32_t elapsed = micros() - start;
+  if (!readStats(&s)) {
+    Serial.print(pattern->name);
+    Serial.println(F(", no answer"));
+    return;
+  }
+  uint32_t busTime = busBits * 1000000UL / clock;
+  uint16_t bytes = s.rxBytes + s.txBytes;
+  uint16_t transfers = s.transactions + s.repeatedStarts;
+
+  Serial.print(pattern->name);                           Serial.print(F(", "));
+  Serial.print(clock);                                   Serial.print(F(", "));
+  Serial.print(transfers);                               Serial.print(F(", "));
+  Serial.print(busBytes);                                Serial.print(F(", "));
+  Serial.print(elapsed);                                 Serial.print(F(", "));
+  Serial.print(busBytes * 1000000UL / elapsed);          Serial.print(F(", "));
+  Serial.print(elapsed > busTime ? (elapsed - busTime) * 100 / elapsed : 0); Serial.print(F(", "));
+  Serial.print(s.interrupts);                            Serial.print(F(", "));
+  Serial.print(bytes ? s.isrTotal / bytes : 0);          Serial.print(F(", "));
+  Serial.print(transfers ? s.isrTotal / transfers : 0);  Serial.print(F(", "));
+  Serial.print(s.isrMax);                                Serial.print(F(", "));
+  Serial.println(s.isrMax * 1000000.0 / SLAVE_F_CPU, 1);
+  if (s.nacks || s.overruns || s.underruns || s.busErrors || s.collisions) {
+    Serial.print(F("#   nacks ")); Serial.print(s.nacks);
+    Serial.print(F(" overruns ")); Serial.print(s.overruns);
+    Serial.print(F(" underruns ")); Serial.print(s.underruns);
+    Serial.print(F(" bus errors ")); Serial.print(s.busErrors);
+    Serial.print(F(" collisions ")); Serial.println(s.collisions);
+  }
+}
+
+void setup()
+{
+  Wire.begin();
+  Serial.begin(115200);
+  Serial.println(F("# pattern, scl_hz, transactions, bytes, elapsed_us, bytes_per_s, idle_pct, isr_calls, cycles_per_byte, cycles_per_transaction, worst_cycles, worst_stretch_us"));
+  for (uint8_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++) {
+    for (uint8_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+      benchmark(&patterns[p], clocks[c]);
+    }
+  }
+  Wire.setClock(100000);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,68 @@
+// ISR Benchmark Slave -- WireS library sample
+//
+// (c) 2015 Hisashi ITO (info at mewpro.cc)
+//
+// Target side of the ISR benchmark; refer to the "ISR Benchmark Master" example for use with this.
+//
+// Serves a 128-byte memory (the first byte of a master write sets the pointer, the following bytes
+// are stored, and a master read sends from the pointer on, wrapping around) so that the master can
+// replay EEPROM sequential reads, register polling, large writes, and repeated START storms.
+// The ISR counts and times itself (see Wire.getStats()); the master reads the statistics through the
+// statistics register and turns them into cycles per byte, worst case SCL stretch, and throughput.
+//
+// In the User Define Section of WireS.h uncomment
+//   #define I2C_STATS_REGISTER 0xFF
+// and leave I2C_STATS_TIMER as TCNT1, which this sketch runs at the CPU clock (PWM on the Timer1 pins
+// is not available then).  Keep the rest of the configuration as it is deployed, so that the numbers
+// are those of the deployed ISR.
+
+#include <WireS.h>
+
+#if !defined(I2C_STATS_REGISTER) || (I2C_STATS_REGISTER != 0xFF) || !defined(I2C_TX_SOURCE)
+#error "define I2C_STATS_REGISTER 0xFF and I2C_TX_SOURCE in WireS.h"
+#endif
+
+#define I2C_SLAVE_ADDRESS 0x20
+#define CMD_CLEAR_STATS   0xFE // a master write of this byte alone clears the statistics
+
+uint8_t mem[128];
+uint8_t pointer;
+
+void setup()
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10); // Timer1 free running at the CPU clock; the ISR times are in CPU cycles
+  Wire.begin(I2C_SLAVE_ADDRESS);
+  Wire.onReceive(receiveEvent);
+  Wire.onRequest(requestEvent);
+}
+
+void loop()
+{
+}
+
+void receiveEvent(size_t numBytes)
+{
+  if (!numBytes) return;
+  uint8_t first = Wire.read();
+  if (first == CMD_CLEAR_STATS && numBytes == 1) {
+    struct i2cStats stats;
+    Wire.getStats(&stats, true);
+    return;
+  }
+  pointer = first & (sizeof(mem) - 1);
+  while (Wire.available()) {
+    mem[pointer++] = Wire.read();
+    pointer &= (sizeof(mem) - 1);
+  }
+}
+
+void requestEvent()
+{
+  // a pointer written just before the repeated START is still in Rx buffer
+  if (Wire.available()) {
+    pointer = Wire.read() & (sizeof(mem) - 1);
+  }
+  // zero-copy; the ISR sends straight from mem
+  Wire.setTxSource(mem, sizeof(mem), I2C_SOURCE_RAM | I2C_SOURCE_WRAP, pointer);
+}
@@ -0,0 +1,56 @@
+/*
+Virtual 24Cxx EEPROM -- WireS library sample
+
+(c) copyright 2015 Hisashi ITO (info at mewpro.cc)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+//
+// 24Cxx I2C Bus Serial EEPROM hardware emulator
+//
+// The emulator is built when I2C_EEPROM_EMULATOR is uncommented in WireS.h.  Device type (size,
+// word address bytes, page length) and wear leveling are set in the User Define Section of
+// WireS_EEPROM.h; 24C01 (128 bytes, 8-byte page) by default.
+//
+// The following functions are completely emulated.
+//   - Device addressing:
+//       1010A2A1A0D  --- D = 1:Read 0:Write
+//   - Byte write and page write
+//   - Current address read
+//   - Random read
+//   - Sequential read of any length (up to I2C_TX_BUFFER_LENGTH without I2C_TX_STREAMING)
+//   - ACK polling
+//
+// Master writes are cached in RAM and committed to in-system programmable EEPROM of
+// micro controller by VirtualEEPROM.poll() in the background.
+//
+#include <WireS.h>
+#include <WireS_EEPROM.h>
+
+#if !defined(I2C_EEPROM_EMULATOR)
+#error "uncomment I2C_EEPROM_EMULATOR in WireS.h"
+#endif
+
+void setup() {
+  VirtualEEPROM.begin(0x50);
+}
+
+void loop() {
+  VirtualEEPROM.poll();
+}
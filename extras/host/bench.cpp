@@ -0,0 +1,191 @@
+/*
+    bench - runs bus traffic against the ISR of WireS at 100kHz, 400kHz, and 1MHz and prints a line of CSV
+            per scenario and bus speed; compare the output with bench_reference.csv by bench_compare.py
+
+    Columns up to bus_us and bus_bytes_per_s follow from the library and the traffic alone and are the same
+    on every host.  The ns columns are host clock times of the ISR and the handlers; an ISR holds SCL until
+    it returns, so stretch_max_ns is the longest stretch and effective_bytes_per_s is the throughput with
+    every ISR added to the bus time.  They compare configurations and revisions on one host; they are not
+    AVR cycles (the I2C_STATS counters of the ISR Benchmark examples measure those on the target).
+    Each scenario runs REPEAT times, and the run of the least host clock time is reported.
+*/
+
+#include <stdio.h>
+#include <WireS.h>
+#include "twi_sim.h"
+
+#define ADDRESS     0x20
+#define RUNS        2000 // transactions (or sequences) of each scenario
+#define READ_LENGTH 32   // bytes of an EEPROM sequential read
+#define STORM       8    // write and read pairs chained by repeated STARTs
+#define REPEAT      5    // runs of each scenario; the one of the least ISR time is reported
+
+#if defined(I2C_RX_STREAMING)
+#define WRITE_LENGTH 128 // bytes of a large write, passed on by onReceiveChunk()
+#else
+#define WRITE_LENGTH I2C_RX_BUFFER_LENGTH
+#endif
+
+static const unsigned long busHz[] = { 100000, 400000, 1000000 };
+
+static uint8_t memory[256];
+static uint8_t pointer;
+static size_t requestLength;
+static uint8_t sink;
+
+static void receiveEvent(size_t numBytes)
+{
+    SIM_HANDLER;
+    if (Wire.available()) {
+        pointer = Wire.read();
+    }
+    while (Wire.available()) {
+        sink ^= Wire.read();
+    }
+}
+
+// the address byte written before the repeated START is still in the Rx buffer
+static void requestEvent(void)
+{
+    SIM_HANDLER;
+    if (Wire.available()) {
+        pointer = Wire.read();
+    }
+    Wire.write(&memory[pointer], requestLength);
+}
+
+#if defined(I2C_TX_SOURCE)
+static void requestSourceEvent(void)
+{
+    SIM_HANDLER;
+    if (Wire.available()) {
+        pointer = Wire.read();
+    }
+    Wire.setTxSource(memory, sizeof(memory), I2C_SOURCE_RAM | I2C_SOURCE_WRAP, pointer);
+}
+#endif
+
+#if defined(I2C_RX_STREAMING)
+static void receiveChunkEvent(const uint8_t* data, size_t length)
+{
+    SIM_HANDLER;
+    for (size_t i = 0; i < length; i++) {
+        sink ^= data[i];
+    }
+}
+#endif
+
+static void reset(unsigned long hz)
+{
+    Wire.begin(ADDRESS);
+    Wire.onReceive(receiveEvent);
+    Wire.onRequest(requestEvent);
+#if defined(I2C_RX_STREAMING)
+    Wire.onReceiveChunk(NULL);
+#endif
+    sim_bus_hz = hz;
+    pointer = 0;
+    sim_clear_stats();
+}
+
+static void report(const char* scenario, const struct simStats* s)
+{
+    unsigned long bytes = (s->bytes ? s->bytes : 1);
+    unsigned long transactions = (s->transactions ? s->transactions : 1);
+
+    printf("%s,%s,%lu,%lu,%lu,%lu,%.2f,%lu,%llu,%.0f,%.1f,%.1f,%lu,%.1f,%.0f\n", BENCH_CONFIG, scenario,
+           sim_bus_hz / 1000, s->transactions, s->bytes, s->isrCalls, (double)s->isrCalls / bytes,
+           s->handlerCalls, s->busNs / 1000, s->bytes * 1e9 / s->busNs,
+           (double)s->isrNs / bytes, (double)s->isrNs / transactions, s->isrMaxNs,
+           (s->handlerCalls ? (double)s->handlerNs / s->handlerCalls : 0.0),
+           s->bytes * 1e9 / (s->busNs + s->isrNs));
+}
+
+// EEPROM sequential read: address byte, repeated START, and a read of READ_LENGTH bytes
+// (taken from a Tx source when there is one)
+static void bench_eeprom_read(void)
+{
+    uint8_t data[READ_LENGTH];
+
+#if defined(I2C_TX_SOURCE)
+    Wire.onRequest(requestSourceEvent);
+#endif
+    requestLength = sizeof(data);
+    for (int i = 0; i < RUNS; i++) {
+        uint8_t address = (i * READ_LENGTH) & (sizeof(memory) - READ_LENGTH);
+        sim_write_to(ADDRESS, &address, 1, false);
+        SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    }
+    uint8_t last = ((RUNS - 1) * READ_LENGTH) & (sizeof(memory) - READ_LENGTH);
+    SIM_CHECK(memcmp(data, &memory[last], sizeof(data)) == 0);
+}
+
+// register pointer write, repeated START, and a read of 2 bytes
+static void bench_register_poll(void)
+{
+    uint8_t reg = 2;
+    uint8_t data[2];
+
+    requestLength = sizeof(data);
+    for (int i = 0; i < RUNS; i++) {
+        sim_write_to(ADDRESS, &reg, 1, false);
+        SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    }
+    SIM_EQUAL(data[0], memory[reg]);
+}
+
+// master writes of WRITE_LENGTH bytes
+static void bench_large_write(void)
+{
+#if defined(I2C_RX_STREAMING)
+    Wire.onReceiveChunk(receiveChunkEvent);
+#endif
+    for (int i = 0; i < RUNS; i++) {
+        SIM_EQUAL(sim_write_to(ADDRESS, memory, WRITE_LENGTH), WRITE_LENGTH);
+    }
+}
+
+// STORM pairs of a 1 byte write and a 1 byte read, each started by a repeated START, then STOP
+static void bench_restart_storm(void)
+{
+    uint8_t data;
+
+    requestLength = 1;
+    for (int i = 0; i < RUNS; i++) {
+        for (uint8_t n = 0; n < STORM; n++) {
+            sim_write_to(ADDRESS, &n, 1, false);
+            SIM_CHECK(sim_read_from(ADDRESS, &data, 1, n + 1 == STORM));
+        }
+    }
+    SIM_EQUAL(data, memory[STORM - 1]);
+}
+
+// runs a scenario REPEAT times at hz; the host clock times of the other runs are taken as disturbed
+static void bench(const char* scenario, void (*run)(void), unsigned long hz)
+{
+    struct simStats best;
+
+    for (int i = 0; i < REPEAT; i++) {
+        reset(hz);
+        run();
+        if (i == 0 || sim_stats.isrNs + sim_stats.handlerNs < best.isrNs + best.handlerNs) {
+            best = sim_stats;
+        }
+    }
+    report(scenario, &best);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(memory); i++) memory[i] = i;
+    printf("config,scenario,bus_khz,transactions,bytes,isr_calls,isr_calls_per_byte,handler_calls,bus_us,"
+           "bus_bytes_per_s,isr_ns_per_byte,isr_ns_per_transaction,stretch_max_ns,handler_ns_per_call,"
+           "effective_bytes_per_s\n");
+    for (size_t i = 0; i < sizeof(busHz) / sizeof(busHz[0]); i++) {
+        bench("eeprom_read", bench_eeprom_read, busHz[i]);
+        bench("register_poll", bench_register_poll, busHz[i]);
+        bench("large_write", bench_large_write, busHz[i]);
+        bench("restart_storm", bench_restart_storm, busHz[i]);
+    }
+    return sim_failures ? 1 : 0;
+}
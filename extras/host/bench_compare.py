@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+#
+#   bench_compare - compare the CSV of the host benchmark with a baseline
+#   Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+#
+#   This library is free software; you can redistribute it and/or
+#   modify it under the terms of the GNU Lesser General Public
+#   License as published by the Free Software Foundation; either
+#   version 2.1 of the License, or (at your option) any later version.
+#
+# usage: bench_compare.py [--tolerance RATIO] BASELINE.csv CURRENT.csv
+#
+# Rows are matched by configuration, scenario, and bus speed.  The counts (ISR invocations, handler calls,
+# bytes, bus time) follow from the library and the traffic alone, so any change of them is reported.
+# The host clock times are compared only if the baseline has them, that is a host-local baseline made on
+# the same host (bench_reference.csv holds the counts alone); they are reported when they are worse by
+# more than RATIO (1.5 by default).  stretch_max_ns is never compared, since a single preemption of the
+# host sets it.  The exit status is 1 if anything is reported.
+
+import argparse
+import csv
+import sys
+
+KEY = ("config", "scenario", "bus_khz")
+COUNTS = ("transactions", "bytes", "isr_calls", "isr_calls_per_byte", "handler_calls", "bus_us",
+          "bus_bytes_per_s")
+# host clock columns (host-local baselines only), whether a larger value is worse, and the difference below
+# which it is noise
+TIMES = (("isr_ns_per_byte", True, 20), ("isr_ns_per_transaction", True, 20), ("handler_ns_per_call", True, 20),
+         ("effective_bytes_per_s", False, 0))
+
+
+def load(path):
+    with open(path, newline="") as f:
+        return {tuple(row[k] for k in KEY): row for row in csv.DictReader(f)}
+
+
+def compare(base, cur, tolerance, out):
+    problems = 0
+    for key in sorted(set(base) | set(cur)):
+        name = ",".join(key)
+        if key not in cur:
+            out.write("%s: missing\n" % name)
+            problems += 1
+            continue
+        if key not in base:
+            out.write("%s: not in baseline\n" % name)
+            problems += 1
+            continue
+        b, c = base[key], cur[key]
+        for col in COUNTS:
+            if b[col] != c[col]:
+                out.write("%s: %s %s -> %s\n" % (name, col, b[col], c[col]))
+                problems += 1
+        for col, larger_is_worse, noise in TIMES:
+            if col not in b:
+                continue
+            bv, cv = float(b[col]), float(c[col])
+            worse, better = (cv, bv) if larger_is_worse else (bv, cv)
+            if worse > better * tolerance and worse - better >= noise:
+                out.write("%s: %s %s -> %s (x%.2f)\n" % (name, col, b[col], c[col], worse / better))
+                problems += 1
+    return problems
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Compare the host benchmark of WireS with a baseline")
+    ap.add_argument("--tolerance", type=float, default=1.5,
+                    help="ratio by which a host clock time may be worse than the baseline (default 1.5)")
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    args = ap.parse_args()
+
+    problems = compare(load(args.baseline), load(args.current), args.tolerance, sys.stdout)
+    if problems:
+        print("%d difference(s) from %s" % (problems, args.baseline))
+        return 1
+    print("same as %s" % args.baseline)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
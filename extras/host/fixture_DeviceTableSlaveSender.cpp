@@ -0,0 +1,27 @@
+/*
+    fixture_DeviceTableSlaveSender - the two address example on the device table
+*/
+
+// prototypes the Arduino builder generates for the sketch
+void requestEvent2(void);
+void requestEvent3(void);
+
+#include "../../examples/DeviceTableSlaveSender/DeviceTableSlaveSender.ino"
+#include "twi_sim.h"
+
+int main(void)
+{
+    uint8_t data[6];
+
+    setup();
+    SIM_CHECK(sim_read_from(2, data, 6));
+    SIM_CHECK(memcmp(data, "hello ", 6) == 0);
+    SIM_CHECK(sim_read_from(3, data, 6));
+    SIM_CHECK(memcmp(data, "aloha ", 6) == 0);
+    SIM_CHECK(sim_read_from(2, data, 6));
+    SIM_CHECK(memcmp(data, "hello ", 6) == 0);
+    SIM_CHECK(!sim_read_from(4, data, 6));
+    loop();
+
+    return sim_report("fixture_DeviceTableSlaveSender");
+}
@@ -0,0 +1,29 @@
+/*
+    fixture_TwoAddressSlaveSender - the two address example, the address told apart by onAddrReceive()
+*/
+
+#include <Arduino.h>
+
+// prototypes the Arduino builder generates for the sketch
+boolean addressEvent(uint16_t address, uint8_t count);
+void requestEvent(void);
+
+#include "../../examples/TwoAddressSlaveSender/TwoAddressSlaveSender.ino"
+#include "twi_sim.h"
+
+int main(void)
+{
+    uint8_t data[6];
+
+    setup();
+    SIM_CHECK(sim_read_from(2, data, 6));
+    SIM_CHECK(memcmp(data, "hello ", 6) == 0);
+    SIM_CHECK(sim_read_from(3, data, 6));
+    SIM_CHECK(memcmp(data, "aloha ", 6) == 0);
+    SIM_CHECK(sim_read_from(2, data, 6));
+    SIM_CHECK(memcmp(data, "hello ", 6) == 0);
+    SIM_CHECK(!sim_read_from(4, data, 6));
+    loop();
+
+    return sim_report("fixture_TwoAddressSlaveSender");
+}
@@ -0,0 +1,96 @@
+/*
+    fixture_Virtual_24Cxx_EEPROM - the VirtualEEPROM example (24C01 by default) driven by a master
+*/
+
+#include "../../examples/Virtual_24Cxx_EEPROM/Virtual_24Cxx_EEPROM.ino"
+#include "twi_sim.h"
+
+// runs loop() until the write-back cache is committed
+static void commit(void)
+{
+    for (int n = 0; VirtualEEPROM.dirty() && n < 10000; n++) {
+        loop();
+        delay(1);
+    }
+    SIM_CHECK(!VirtualEEPROM.dirty());
+    delay(4); // the last write cycle
+}
+
+static void randomRead(uint8_t address, uint8_t* data, size_t length)
+{
+    SIM_EQUAL(sim_write_to(0x50, &address, 1, false), 1);
+    SIM_CHECK(sim_read_from(0x50, data, length));
+}
+
+int main(void)
+{
+    uint8_t page[1 + I2C_EEPROM_PAGE_LENGTH];
+    uint8_t data[I2C_EEPROM_PAGE_LENGTH + 2];
+
+    memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+    setup();
+
+    // page write; read back from the cache before it is committed
+    page[0] = 0x10;
+    for (int i = 0; i < I2C_EEPROM_PAGE_LENGTH; i++) page[1 + i] = 0x30 + i;
+    SIM_EQUAL(sim_write_to(0x50, page, sizeof(page)), sizeof(page));
+    randomRead(0x10, data, I2C_EEPROM_PAGE_LENGTH);
+    SIM_CHECK(memcmp(data, page + 1, I2C_EEPROM_PAGE_LENGTH) == 0);
+
+    // while internal EEPROM is being written, the cached page is still read and a write is still taken
+    loop();
+    SIM_CHECK(!eeprom_is_ready());
+    randomRead(0x10, data, I2C_EEPROM_PAGE_LENGTH);
+    SIM_CHECK(memcmp(data, page + 1, I2C_EEPROM_PAGE_LENGTH) == 0);
+    SIM_CHECK(sim_start(0x50, false));
+    sim_stop();
+    SIM_CHECK(!eeprom_is_ready());
+    commit();
+
+    // read, repeated START, read: the second read goes on from the first, not from a stale word address
+    randomRead(0x10, data, 1);
+    SIM_CHECK(sim_read_from(0x50, data, 1, false));
+    SIM_CHECK(sim_read_from(0x50, data + 1, 1));
+    SIM_EQUAL(data[0], 0x31);
+    SIM_EQUAL(data[1], 0x32);
+
+    // the address rolls over within the page on write, and at the end of the device on read
+    const uint8_t rollover[] = { I2C_EEPROM_SIZE - 1, 0xE1, 0xE2 };
+    SIM_EQUAL(sim_write_to(0x50, rollover, sizeof(rollover)), sizeof(rollover));
+    randomRead(I2C_EEPROM_SIZE - I2C_EEPROM_PAGE_LENGTH, data, 1);
+    SIM_EQUAL(data[0], 0xE2);
+    randomRead(I2C_EEPROM_SIZE - 1, data, 2);
+    SIM_EQUAL(data[0], 0xE1);
+    SIM_EQUAL(data[1], 0xFF);
+
+    // the committed pages survive a restart
+    commit();
+    setup();
+    randomRead(0x10, data, I2C_EEPROM_PAGE_LENGTH);
+    SIM_CHECK(memcmp(data, page + 1, I2C_EEPROM_PAGE_LENGTH) == 0);
+    randomRead(I2C_EEPROM_SIZE - 1, data, 1);
+    SIM_EQUAL(data[0], 0xE1);
+
+    // a write to a page not cached while internal EEPROM is being written; the rest of the page is
+    // read in later, and only a read of the bytes not written is NACKed meanwhile (ACK polling)
+    const uint8_t other[] = { 0x40, 0x55 };
+    const uint8_t partial[] = { 0x12, 0x99 };
+    uint8_t word = 0x10;
+    SIM_EQUAL(sim_write_to(0x50, other, sizeof(other)), sizeof(other));
+    loop();
+    SIM_CHECK(!eeprom_is_ready());
+    SIM_EQUAL(sim_write_to(0x50, partial, sizeof(partial)), sizeof(partial));
+    randomRead(0x12, data, 1);
+    SIM_EQUAL(data[0], 0x99);
+    SIM_EQUAL(sim_write_to(0x50, &word, 1, false), 1);
+    SIM_CHECK(!sim_read_from(0x50, data, 1));
+    SIM_CHECK(!eeprom_is_ready());
+    commit();
+    randomRead(0x10, data, I2C_EEPROM_PAGE_LENGTH);
+    SIM_EQUAL(data[0], 0x30);
+    SIM_EQUAL(data[1], 0x31);
+    SIM_EQUAL(data[2], 0x99);
+    SIM_EQUAL(data[3], 0x33);
+
+    return sim_report("fixture_Virtual_24Cxx_EEPROM");
+}
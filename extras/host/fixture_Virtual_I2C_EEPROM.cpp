@@ -0,0 +1,45 @@
+/*
+    fixture_Virtual_I2C_EEPROM - the 24AA00 emulator example driven by a master
+*/
+
+#include "../../examples/Virtual_I2C_EEPROM/Virtual_I2C_EEPROM.ino"
+#include "twi_sim.h"
+
+int main(void)
+{
+    uint8_t data[4];
+
+    for (int i = 0; i < ROMSIZE; i++) {
+        sim_eeprom[EEPROMOFFSET + i] = 0xA0 + i;
+    }
+    setup();
+
+    // byte write
+    const uint8_t byteWrite[] = { 3, 0x5A };
+    SIM_EQUAL(sim_write_to(0x50, byteWrite, sizeof(byteWrite)), 2);
+    SIM_EQUAL(sim_eeprom[EEPROMOFFSET + 3], 0x5A);
+
+    // random read, then current address read goes on after it
+    uint8_t wordAddr = 3;
+    SIM_EQUAL(sim_write_to(0x50, &wordAddr, 1, false), 1);
+    SIM_CHECK(sim_read_from(0x50, data, 2));
+    SIM_EQUAL(data[0], 0x5A);
+    SIM_EQUAL(data[1], 0xA4);
+    SIM_CHECK(sim_read_from(0x50, data, 1));
+    SIM_EQUAL(data[0], 5); // the example answers a current address read with the address
+
+    // sequential read wraps around at the end, and an out of range word address is reduced
+    wordAddr = ROMSIZE * 2 + 14;
+    SIM_EQUAL(sim_write_to(0x50, &wordAddr, 1, false), 1);
+    SIM_CHECK(sim_read_from(0x50, data, 4));
+    SIM_EQUAL(data[0], 0xAE);
+    SIM_EQUAL(data[1], 0xAF);
+    SIM_EQUAL(data[2], 0xA0);
+    SIM_EQUAL(data[3], 0xA1);
+
+    // the lower three bits of the device address are don't care
+    SIM_CHECK(sim_read_from(0x57, data, 1));
+    SIM_CHECK(!sim_read_from(0x58, data, 1));
+
+    return sim_report("fixture_Virtual_I2C_EEPROM");
+}
@@ -0,0 +1,44 @@
+/*
+    fixture_attiny841_i2c_analog - the register example on the plain API driven by a master, with a simulated ADC
+*/
+
+#include "../../examples/attiny841_i2c_analog/attiny841_i2c_analog.ino"
+#include "twi_sim.h"
+
+static void readRegisters(uint8_t first, uint8_t* data, size_t length)
+{
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, &first, 1, false), 1);
+    SIM_CHECK(sim_read_from(I2C_SLAVE_ADDRESS, data, length));
+}
+
+int main(void)
+{
+    uint8_t data[4];
+
+    setup();
+    sim_adc_value = 0x0234;
+
+    // start a conversion on channel 3
+    const uint8_t start[] = { 0, 0x80 | 3 };
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, start, sizeof(start)), sizeof(start));
+    for (int i = 0; i < 4; i++) loop();
+    SIM_EQUAL(sim_adc_channel, 3);
+    SIM_EQUAL(sim_adc_starts, 1);
+
+    // the flag is cleared and the result is in registers 2 and 3
+    readRegisters(0, data, 4);
+    SIM_EQUAL(data[0], 3);
+    SIM_EQUAL(data[1], 1);
+    SIM_EQUAL(data[2], 0x34);
+    SIM_EQUAL(data[3], 0x02);
+
+    // the register pointer wraps around, and goes on after a read
+    readRegisters(3, data, 3);
+    SIM_EQUAL(data[0], 0x02);
+    SIM_EQUAL(data[1], 3);
+    SIM_EQUAL(data[2], 1);
+    SIM_CHECK(sim_read_from(I2C_SLAVE_ADDRESS, data, 1));
+    SIM_EQUAL(data[0], 0x34);
+
+    return sim_report("fixture_attiny841_i2c_analog");
+}
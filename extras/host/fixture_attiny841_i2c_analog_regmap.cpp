@@ -0,0 +1,60 @@
+/*
+    fixture_attiny841_i2c_analog_regmap - the register file example driven by a master, with a simulated ADC
+*/
+
+#include "../../examples/attiny841_i2c_analog_regmap/attiny841_i2c_analog_regmap.ino"
+#include "twi_sim.h"
+
+static void readRegisters(uint8_t first, uint8_t* data, size_t length)
+{
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, &first, 1, false), 1);
+    SIM_CHECK(sim_read_from(I2C_SLAVE_ADDRESS, data, length));
+}
+
+int main(void)
+{
+    uint8_t data[4];
+
+    setup();
+    sim_adc_value = 0x0234;
+
+    // start a conversion on channel 3
+    const uint8_t start[] = { 0, 0x80 | 3 };
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, start, sizeof(start)), sizeof(start));
+    for (int i = 0; i < 4; i++) loop();
+    SIM_EQUAL(sim_adc_channel, 3);
+    SIM_EQUAL(sim_adc_starts, 1);
+
+    // the flag is cleared and the result is in registers 2 and 3
+    readRegisters(0, data, 4);
+    SIM_EQUAL(data[0], 3);
+    SIM_EQUAL(data[1], 1);
+    SIM_EQUAL(data[2], 0x34);
+    SIM_EQUAL(data[3], 0x02);
+
+    // the result registers are read-only, and the register pointer wraps around
+    const uint8_t write[] = { 2, 0xFF, 0xFF };
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, write, sizeof(write)), sizeof(write));
+    readRegisters(3, data, 3);
+    SIM_EQUAL(data[0], 0x02);
+    SIM_EQUAL(data[1], 3);
+    SIM_EQUAL(data[2], 1);
+
+    // a new result published during a read does not tear the one being sent
+    sim_adc_value = 0x0456;
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, start, sizeof(start)), sizeof(start));
+    uint8_t first = 2;
+    SIM_EQUAL(sim_write_to(I2C_SLAVE_ADDRESS, &first, 1, false), 1);
+    SIM_CHECK(sim_start(I2C_SLAVE_ADDRESS, true));
+    data[0] = sim_read(true);
+    for (int i = 0; i < 4; i++) loop();
+    data[1] = sim_read(false);
+    sim_stop();
+    SIM_EQUAL(data[0], 0x34);
+    SIM_EQUAL(data[1], 0x02);
+    readRegisters(2, data, 2);
+    SIM_EQUAL(data[0], 0x56);
+    SIM_EQUAL(data[1], 0x04);
+
+    return sim_report("fixture_attiny841_i2c_analog_regmap");
+}
@@ -0,0 +1,88 @@
+/*
+    Arduino.h - the part of the Arduino core used by WireS and its examples, for the host harness
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define B110      6
+#define B0010     2
+#define B0011     3
+#define B0110     6
+#define B0111     7
+#define B1110     14
+#define B11110000 240
+#define B11110001 241
+#define B11111001 249
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+#define lowByte(w)              ((uint8_t)((w) & 0xff))
+#define highByte(w)             ((uint8_t)((w) >> 8))
+#define bitRead(value, bit)     (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit)      ((value) |= (1UL << (bit)))
+#define bitClear(value, bit)    ((value) &= ~(1UL << (bit)))
+#define noInterrupts()          cli()
+#define interrupts()            sei()
+
+// simulated time (see twi_sim.cpp); it advances with the bus traffic and delay()
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {}
+#define digitalPinToPort(pin)    (pin)
+#define digitalPinToBitMask(pin) ((uint8_t)(1 << ((pin) & 7)))
+#define portOutputRegister(port) (&PORTA)
+
+class Print
+{
+  public:
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(unsigned long n, int base = 10)
+    {
+        char buf[8 * sizeof(long) + 1];
+        char* p = &buf[sizeof(buf) - 1];
+        *p = '\0';
+        do {
+            uint8_t d = n % base;
+            *--p = (d < 10 ? '0' + d : 'A' + d - 10);
+            n /= base;
+        } while (n);
+        return print(p);
+    }
+    size_t println(void) { return print("\r\n"); }
+    size_t println(const char* s) { return print(s) + println(); }
+    size_t println(unsigned long n, int base = 10) { return print(n, base) + println(); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+};
+
+#endif
@@ -0,0 +1,21 @@
+/*
+    EEPROM.h - the read()/write()/update() part of the Arduino EEPROM library, on the simulated EEPROM
+*/
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+struct EEPROMClass
+{
+    uint8_t read(int idx) { return eeprom_read_byte((const uint8_t*)(uintptr_t)idx); }
+    void write(int idx, uint8_t val) { eeprom_write_byte((uint8_t*)(uintptr_t)idx, val); }
+    void update(int idx, uint8_t val) { eeprom_update_byte((uint8_t*)(uintptr_t)idx, val); }
+    uint16_t length() { return E2END + 1; }
+};
+
+static EEPROMClass EEPROM;
+
+#endif
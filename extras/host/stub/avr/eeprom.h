@@ -0,0 +1,18 @@
+/*
+    avr/eeprom.h - simulated EEPROM of E2END + 1 bytes; a write keeps it busy for the time of a real
+                   write cycle in simulated time (see twi_sim.cpp)
+*/
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t* p);
+void eeprom_write_byte(uint8_t* p, uint8_t value);
+void eeprom_update_byte(uint8_t* p, uint8_t value);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+int eeprom_is_ready(void);
+void eeprom_busy_wait(void);
+
+#endif
@@ -0,0 +1,15 @@
+/*
+    avr/interrupt.h - the harness calls the ISR from twi_sim.cpp; cli() and sei() clear and set the I bit of
+                      SREG, which twi_sim.cpp clears while the ISR runs and checks before it delivers a bus event
+*/
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#define ISR_NOBLOCK
+#define cli() do { SREG &= (uint8_t)~_BV(SREG_I); } while (0)
+#define sei() do { SREG |= _BV(SREG_I); } while (0)
+
+#endif
@@ -0,0 +1,52 @@
+/*
+    avr/io.h - simulated ATtiny841 registers for the host harness; the TWI slave is modeled in twi_sim.cpp
+*/
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <stdint.h>
+
+extern volatile uint8_t TWSCRA, TWSCRB, TWSSRA, TWSA, TWSAM, TWSD;
+extern volatile uint8_t SREG, PORTA;
+
+// free running timers read the host clock, so that I2C_STATS and the trace time the ISR as it runs here
+uint16_t sim_timer(void);
+#define TCNT0 ((uint8_t)sim_timer())
+#define TCNT1 sim_timer()
+
+#define _BV(bit) (1 << (bit))
+
+// SREG
+#define SREG_I 7
+
+// TWSCRA
+#define TWSHE  7
+#define TWDIE  5
+#define TWASIE 4
+#define TWEN   3
+#define TWSIE  2
+#define TWPME  1
+#define TWSME  0
+// TWSCRB
+#define TWHNM  3
+#define TWAA   2
+#define TWCMD1 1
+#define TWCMD0 0
+// TWSSRA
+#define TWDIF  7
+#define TWASIF 6
+#define TWCH   5
+#define TWRA   4
+#define TWC    3
+#define TWBE   2
+#define TWDIR  1
+#define TWAS   0
+// TWSAM
+#define TWAE   0
+
+#define RAMEND       0x2FF
+#define E2END        0x1FF
+#define FLASHEND     0x1FFF
+#define SPM_PAGESIZE 16
+
+#endif
@@ -0,0 +1,18 @@
+/*
+    avr/sleep.h - sleeping runs sim_wake() of twi_sim.cpp, whose bus events stand for what wakes the device
+*/
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_PWR_DOWN 2
+#define SLEEP_MODE_STANDBY  6
+
+void sim_sleep_cpu(void);
+
+#define set_sleep_mode(mode) do {} while (0)
+#define sleep_enable()       do {} while (0)
+#define sleep_disable()      do {} while (0)
+#define sleep_cpu()          sim_sleep_cpu()
+
+#endif
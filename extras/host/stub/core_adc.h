@@ -0,0 +1,20 @@
+/*
+    core_adc.h - the ADC_xxx helpers of the tiny core; a conversion completes at once with sim_adc_value
+*/
+#ifndef core_adc_h
+#define core_adc_h
+
+#include <stdint.h>
+
+typedef uint8_t adc_ic_t;
+
+extern uint16_t sim_adc_value;   // result of every conversion
+extern adc_ic_t sim_adc_channel; // channel of the last conversion
+extern unsigned sim_adc_starts;  // number of conversions started
+
+inline void ADC_SetInputChannel(adc_ic_t ic) { sim_adc_channel = ic; }
+inline void ADC_StartConversion(void) { sim_adc_starts++; }
+inline uint8_t ADC_ConversionInProgress(void) { return 0; }
+inline uint16_t ADC_GetDataRegister(void) { return sim_adc_value; }
+
+#endif
@@ -0,0 +1,940 @@
+/*
+    test_core - bus events against the ISR of WireS; built for each configuration of the Makefile, the
+                tests of an optional feature run where it is enabled
+*/
+
+#include <stdio.h>
+#include <WireS.h>
+#include "twi_sim.h"
+#if defined(I2C_SLEEP)
+#include <avr/sleep.h>
+#endif
+
+#define ADDRESS 0x20
+
+static uint8_t rxData[256];
+static size_t rxCount;        // bytes read by onReceive()
+static size_t rxNumBytes;     // numBytes of the last onReceive()
+static unsigned receives;
+static unsigned requests;
+static unsigned stops;
+static int addrStartCount;
+static const char* response;  // written by onRequest()
+
+static boolean addrEvent(uint16_t address, uint8_t startCount)
+{
+    addrStartCount = startCount;
+    return true;
+}
+
+static void receiveEvent(size_t numBytes)
+{
+    receives++;
+    rxNumBytes = numBytes;
+    while (Wire.available() && rxCount < sizeof(rxData)) {
+        rxData[rxCount++] = Wire.read();
+    }
+}
+
+static void requestEvent(void)
+{
+    requests++;
+    if (response != NULL) {
+        Wire.write(response);
+    }
+}
+
+static void stopEvent(void)
+{
+    stops++;
+}
+
+static void reset(void)
+{
+    Wire.begin(ADDRESS);
+    sim_write_to(ADDRESS, NULL, 0); // leaves no byte in Rx buffer
+    Wire.onAddrReceive(addrEvent);
+    Wire.onReceive(receiveEvent);
+    Wire.onRequest(requestEvent);
+    Wire.onStop(stopEvent);
+    rxCount = rxNumBytes = 0;
+    receives = requests = stops = 0;
+    addrStartCount = -1;
+    response = NULL;
+}
+
+static void test_write(void)
+{
+    const uint8_t data[] = { 1, 2, 3, 4, 5 };
+
+    reset();
+    SIM_EQUAL(sim_write_to(ADDRESS, data, sizeof(data)), sizeof(data));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxNumBytes, sizeof(data));
+    SIM_EQUAL(rxCount, sizeof(data));
+    SIM_CHECK(memcmp(rxData, data, sizeof(data)) == 0);
+    SIM_EQUAL(addrStartCount, 0);
+}
+
+static void test_address_mismatch(void)
+{
+    reset();
+    SIM_CHECK(!sim_start(ADDRESS + 1, false));
+    sim_stop();
+    SIM_EQUAL(receives, 0);
+    Wire.begin(ADDRESS, (ADDRESS + 1) << 1 | 1); // second address
+    SIM_CHECK(sim_start(ADDRESS + 1, true));
+    sim_read(false);
+    sim_stop();
+    SIM_EQUAL(requests, 1);
+}
+
+static void test_read(void)
+{
+    uint8_t data[8];
+
+    reset();
+    response = "hello";
+    SIM_CHECK(sim_read_from(ADDRESS, data, 5));
+    SIM_CHECK(memcmp(data, "hello", 5) == 0);
+    SIM_EQUAL(requests, 1);
+    SIM_EQUAL(stops, 1);
+    SIM_EQUAL(Wire.getTransmitBytes(), 5);
+    // the master reads past the response; the slave releases SDA
+    SIM_CHECK(sim_read_from(ADDRESS, data, 7));
+    SIM_EQUAL(data[4], 'o');
+    SIM_EQUAL(data[5], 0xFF);
+    SIM_EQUAL(data[6], 0xFF);
+}
+
+static void test_repeated_start(void)
+{
+    uint8_t reg = 0x42;
+    uint8_t data[2];
+
+    reset();
+    response = "ab";
+    SIM_EQUAL(sim_write_to(ADDRESS, &reg, 1, false), 1);
+    SIM_EQUAL(addrStartCount, 0);
+    SIM_CHECK(sim_read_from(ADDRESS, data, 2));
+    SIM_EQUAL(addrStartCount, 1);
+    SIM_EQUAL(data[0], 'a');
+    SIM_EQUAL(data[1], 'b');
+    SIM_EQUAL(stops, 1);
+}
+
+static void test_overrun(void)
+{
+    uint8_t data[I2C_RX_BUFFER_LENGTH + 4];
+
+    reset();
+#if defined(I2C_RX_STREAMING)
+    Wire.onReceiveChunk(NULL);
+#endif
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = i;
+    SIM_EQUAL(sim_write_to(ADDRESS, data, sizeof(data)), I2C_RX_BUFFER_LENGTH);
+    SIM_EQUAL(rxCount, I2C_RX_BUFFER_LENGTH);
+    SIM_CHECK(memcmp(rxData, data, I2C_RX_BUFFER_LENGTH) == 0);
+}
+
+static void test_errors(void)
+{
+    const uint8_t data[] = { 7, 8 };
+    uint8_t in[3];
+
+    reset();
+    response = "xyz";
+    SIM_CHECK(sim_start(ADDRESS, false));
+    SIM_CHECK(sim_write(1));
+    sim_bus_error();
+    SIM_EQUAL(receives, 0);
+    SIM_EQUAL(sim_write_to(ADDRESS, data, 2), 2);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxCount, 2);
+    SIM_EQUAL(addrStartCount, 0); // not a repeated START after the error
+
+    SIM_CHECK(sim_start(ADDRESS, true));
+    sim_read(true);
+    sim_collision();
+    sim_stop();
+    SIM_CHECK(sim_read_from(ADDRESS, in, 3));
+    SIM_CHECK(memcmp(in, "xyz", 3) == 0);
+}
+
+static void requestTypedEvent(void)
+{
+    Wire.writeU16(0x1234);
+    Wire.writeU16BE(0x1234);
+    Wire.writeU32(0x89ABCDEF);
+    Wire.writeU32BE(0x89ABCDEF);
+}
+
+static uint16_t typedU16;
+static uint32_t typedU32;
+static uint8_t typedPeek;
+static size_t typedRead, typedSkip, typedSpan, typedLeft;
+static uint8_t typedData[4];
+
+static void receiveTypedEvent(size_t numBytes)
+{
+    const uint8_t* span;
+
+    receives++;
+    typedPeek = Wire.peekByte();
+    typedU16 = Wire.readU16();
+    typedU32 = Wire.readU32BE();
+    typedRead = Wire.read(typedData, 3);
+    typedSkip = Wire.skip(2);
+    typedSpan = Wire.getRxSpan(&span);
+    rxData[0] = span[0];
+    typedLeft = Wire.readU16(); // one byte is left; nothing is read
+    typedLeft = Wire.available();
+}
+
+// the typed values go LSB first (or MSB first for xxxBE), and the bulk reads stop at the end of the bytes
+static void test_typed(void)
+{
+    const uint8_t write[] = { 0x34, 0x12, 0x89, 0xAB, 0xCD, 0xEF, 1, 2, 3, 4, 5, 6 };
+    const uint8_t expected[] = { 0x34, 0x12, 0x12, 0x34, 0xEF, 0xCD, 0xAB, 0x89, 0x89, 0xAB, 0xCD, 0xEF };
+    uint8_t data[sizeof(expected)];
+
+    reset();
+    Wire.onRequest(requestTypedEvent);
+    Wire.onReceive(receiveTypedEvent);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_CHECK(memcmp(data, expected, sizeof(expected)) == 0);
+    SIM_EQUAL(sim_write_to(ADDRESS, write, sizeof(write)), sizeof(write));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(typedPeek, 0x34);
+    SIM_EQUAL(typedU16, 0x1234);
+    SIM_EQUAL(typedU32, 0x89ABCDEF);
+    SIM_EQUAL(typedRead, 3);
+    SIM_CHECK(memcmp(typedData, write + 6, 3) == 0);
+    SIM_EQUAL(typedSkip, 2);
+    SIM_EQUAL(typedSpan, 1);
+    SIM_EQUAL(rxData[0], 6);
+    SIM_EQUAL(typedLeft, 1);
+}
+
+#if defined(I2C_RX_STREAMING)
+static size_t chunkTotal;
+static size_t chunkMax;
+static boolean chunkData;
+
+static void receiveChunkEvent(const uint8_t* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != (uint8_t)(chunkTotal + i)) chunkData = false;
+    }
+    chunkTotal += length;
+    if (length > chunkMax) chunkMax = length;
+}
+
+// a long write is passed on in contiguous spans of up to a chunk, and onReceive() gets no bytes
+static void test_rx_streaming(void)
+{
+    uint8_t data[200];
+
+    reset();
+    Wire.onReceiveChunk(receiveChunkEvent);
+    chunkTotal = chunkMax = 0;
+    chunkData = true;
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = i;
+    SIM_EQUAL(sim_write_to(ADDRESS, data, sizeof(data)), sizeof(data));
+    SIM_EQUAL(chunkTotal, sizeof(data));
+    SIM_CHECK(chunkMax <= I2C_RX_CHUNK_LENGTH);
+    SIM_CHECK(chunkData);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxNumBytes, 0);
+    Wire.onReceiveChunk(NULL);
+}
+
+static size_t nestedWrite;     // bytes the first onReceiveChunk() call writes as master while it runs
+static boolean nestedStop;     // and a STOP after them
+static boolean chunkInterrupts; // the first call runs with interrupts enabled
+static unsigned chunkCalls;
+
+static void receiveChunkNested(const uint8_t* data, size_t length)
+{
+    receiveChunkEvent(data, length);
+    if (chunkCalls++ == 0) {
+        chunkInterrupts = (SREG & _BV(SREG_I));
+        for (size_t i = 0; i < nestedWrite; i++) {
+            sim_write((uint8_t)(chunkTotal + i));
+        }
+        if (nestedStop) {
+            sim_stop();
+        }
+    }
+}
+
+// starts a write and sends a chunk, whose handler writes the bytes (and the STOP) that come in meanwhile
+static void rx_nested(size_t count, boolean stop)
+{
+    reset();
+    Wire.onReceiveChunk(receiveChunkNested);
+    chunkTotal = chunkMax = 0;
+    chunkData = true;
+    chunkCalls = 0;
+    chunkInterrupts = false;
+    nestedWrite = count;
+    nestedStop = stop;
+    SIM_CHECK(sim_start(ADDRESS, false));
+    for (size_t i = 0; i < I2C_RX_CHUNK_LENGTH; i++) {
+        SIM_CHECK(sim_write(i));
+    }
+}
+
+// the bus goes on while onReceiveChunk() runs: the other half of Rx buffer fills, then SCL is held until
+// the handler returns; a STOP meanwhile is taken after it
+static void test_rx_nested(void)
+{
+    size_t held = sim_stats.holds;
+
+    rx_nested(I2C_RX_CHUNK_LENGTH + 1, false); // the last byte finds Rx buffer full
+    SIM_CHECK(chunkInterrupts);
+    SIM_CHECK(sim_stats.holds > held);
+    SIM_EQUAL(sim_held_result, true);
+    SIM_EQUAL(chunkTotal, 2 * I2C_RX_CHUNK_LENGTH);
+    for (size_t i = 0; i < 3; i++) {
+        SIM_CHECK(sim_write(2 * I2C_RX_CHUNK_LENGTH + 1 + i));
+    }
+    sim_stop();
+    SIM_EQUAL(chunkTotal, 2 * I2C_RX_CHUNK_LENGTH + 4);
+    SIM_CHECK(chunkData);
+    SIM_EQUAL(receives, 1);
+
+    rx_nested(5, true);
+    SIM_EQUAL(chunkTotal, I2C_RX_CHUNK_LENGTH + 5);
+    SIM_CHECK(chunkData);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxNumBytes, 0);
+    Wire.onReceiveChunk(NULL);
+}
+#endif
+
+#if defined(I2C_TX_STREAMING)
+static uint8_t next;
+static boolean chunkInterruptsTx; // onRequestMore() runs with interrupts enabled
+
+static void fill(uint8_t count)
+{
+    while (count-- && Wire.write(next)) next++;
+}
+
+static void requestFirstEvent(void)
+{
+    next = 0;
+    fill(2);
+}
+
+static void requestMoreEvent(void)
+{
+    fill(I2C_TX_REFILL_LEVEL);
+}
+
+// a read longer than the Tx buffer is refilled while it goes on
+static void test_tx_streaming(void)
+{
+    uint8_t data[150];
+    boolean ok = true;
+
+    reset();
+    Wire.onRequest(requestFirstEvent);
+    Wire.onRequestMore(requestMoreEvent);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    for (size_t i = 0; i < sizeof(data); i++) {
+        if (data[i] != (uint8_t)i) ok = false;
+    }
+    SIM_CHECK(ok);
+    SIM_EQUAL(Wire.getTransmitBytes(), sizeof(data));
+    Wire.onRequestMore(NULL);
+}
+
+static uint8_t nestedRead[2];
+static unsigned refills;
+
+// reads the rest of Tx buffer and one byte more as master before it refills; that byte holds SCL
+static void requestMoreNested(void)
+{
+    if (refills++ == 0) {
+        chunkInterruptsTx = (SREG & _BV(SREG_I));
+        nestedRead[0] = sim_read(true);
+        nestedRead[1] = sim_read(true);
+    }
+    fill(I2C_TX_REFILL_LEVEL);
+}
+
+// the bus goes on while onRequestMore() runs, and SCL is held once Tx buffer runs dry
+static void test_tx_nested(void)
+{
+    uint8_t data[40];
+    boolean ok = true;
+
+    reset();
+    Wire.onRequest(requestFirstEvent);
+    Wire.onRequestMore(requestMoreNested);
+    refills = 0;
+    chunkInterruptsTx = false;
+    SIM_CHECK(sim_start(ADDRESS, true));
+    data[0] = sim_read(true);  // the first refill runs after this byte
+    SIM_CHECK(chunkInterruptsTx);
+    SIM_EQUAL(nestedRead[0], 1);
+    SIM_EQUAL(nestedRead[1], 0xFF); // held; sent after the refill
+    data[1] = nestedRead[0];
+    data[2] = sim_held_result;
+    for (size_t i = 3; i < sizeof(data); i++) {
+        data[i] = sim_read(i + 1 < sizeof(data));
+    }
+    sim_stop();
+    for (size_t i = 0; i < sizeof(data); i++) {
+        if (data[i] != (uint8_t)i) ok = false;
+    }
+    SIM_CHECK(ok);
+    SIM_CHECK(refills > 1);
+    Wire.onRequestMore(NULL);
+}
+#endif
+
+#if defined(I2C_DEFERRED) && defined(I2C_TX_SOURCE)
+static const uint8_t source[] = { 's', 't', 'u' };
+
+static void requestStagedEvent(void)
+{
+    Wire.write("AB");
+    Wire.setTxSource(source, sizeof(source), I2C_SOURCE_RAM | I2C_SOURCE_WRAP);
+}
+
+// a second read before poll() sends the staged bytes again, and the source goes on where it stopped
+static void test_deferred_source(void)
+{
+    uint8_t data[4];
+
+    reset();
+    Wire.onRequest(requestStagedEvent);
+    Wire.setDeferred(true);
+    Wire.poll();
+    SIM_CHECK(sim_read_from(ADDRESS, data, 4));
+    SIM_CHECK(memcmp(data, "ABst", 4) == 0);
+    SIM_CHECK(sim_read_from(ADDRESS, data, 4));
+    SIM_CHECK(memcmp(data, "ABus", 4) == 0);
+    Wire.poll();
+    SIM_EQUAL(stops, 2);
+    SIM_CHECK(sim_read_from(ADDRESS, data, 4));
+    SIM_CHECK(memcmp(data, "ABst", 4) == 0);
+    Wire.setDeferred(false);
+}
+#endif
+
+#if defined(I2C_REGISTER_MAP)
+static volatile uint8_t regs[8];
+static const uint8_t regMask[8] = { 0xFF, 0x0F, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+// the first byte of a write sets the pointer (modulo the size), the others go through the write masks;
+// a read sends from the pointer, and both wrap around
+static void test_register_map(void)
+{
+    const uint8_t write[] = { sizeof(regs) + 1, 0xAB, 0xCD, 0x12 };
+    uint8_t reg = 6;
+    uint8_t data[3];
+
+    reset();
+    for (size_t i = 0; i < sizeof(regs); i++) regs[i] = 0xF0 + i;
+    Wire.setRegisters(regs, sizeof(regs), regMask);
+    SIM_EQUAL(sim_write_to(ADDRESS, write, sizeof(write)), sizeof(write));
+    SIM_EQUAL(regs[1], 0xFB);
+    SIM_EQUAL(regs[2], 0xF2); // read-only
+    SIM_EQUAL(regs[3], 0x12);
+    SIM_EQUAL(Wire.getRegisterPointer(), 4);
+#if I2C_REG_QUEUE_LENGTH
+    uint8_t first, count;
+    SIM_CHECK(Wire.getRegisterWrite(&first, &count));
+    SIM_EQUAL(first, 1);
+    SIM_EQUAL(count, 3);
+    SIM_CHECK(!Wire.getRegisterWrite(&first, &count));
+#endif
+
+    SIM_EQUAL(sim_write_to(ADDRESS, &reg, 1, false), 1);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_EQUAL(data[0], 0xF6);
+    SIM_EQUAL(data[1], 0xF7);
+    SIM_EQUAL(data[2], 0xF0);
+    SIM_EQUAL(Wire.getRegisterPointer(), 1);
+#if I2C_REG_QUEUE_LENGTH
+    SIM_CHECK(!Wire.getRegisterWrite(&first, &count)); // the pointer alone writes no register
+#endif
+    Wire.setRegisters(NULL, 0);
+}
+#endif
+
+#if defined(I2C_SNAPSHOT) && defined(I2C_TX_SOURCE)
+static uint8_t snapA[3], snapB[3];
+
+// a read sends the snapshot published when it began, even if another is published meanwhile
+static void test_snapshot(void)
+{
+    uint8_t* back;
+    uint8_t data[3];
+
+    reset();
+    Wire.setSnapshot(snapA, snapB, sizeof(snapA));
+    back = (uint8_t*)Wire.getSnapshot();
+    SIM_CHECK(back == snapB);
+    memcpy(back, "\x04\x05\x06", 3);
+    Wire.publishSnapshot();
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_CHECK(memcmp(data, "\x04\x05\x06", 3) == 0);
+    SIM_EQUAL(requests, 0);
+
+    SIM_CHECK(sim_start(ADDRESS, true));
+    data[0] = sim_read(true);
+    back = (uint8_t*)Wire.getSnapshot();
+    SIM_CHECK(back == snapA);
+    memcpy(back, "\x07\x08\x09", 3);
+    Wire.publishSnapshot();
+    SIM_CHECK(Wire.getSnapshot() == NULL); // snapB is still being sent
+    data[1] = sim_read(true);
+    data[2] = sim_read(false);
+    sim_stop();
+    SIM_CHECK(memcmp(data, "\x04\x05\x06", 3) == 0);
+    SIM_CHECK(Wire.getSnapshot() == snapB);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_CHECK(memcmp(data, "\x07\x08\x09", 3) == 0);
+    Wire.setSnapshot(NULL, NULL, 0);
+}
+#endif
+
+#if defined(I2C_SMBUS)
+// CRC-8 of SMBus PEC (polynomial x^8 + x^2 + x + 1)
+static uint8_t crc8(uint8_t crc, const uint8_t* data, size_t length)
+{
+    while (length--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+    return crc;
+}
+
+// PEC covers the address bytes and the data; a write of a bad one is discarded, and a read gets one appended
+static void test_smbus_pec(void)
+{
+    uint8_t write[] = { ADDRESS << 1, 0x10, 0x20, 0 };
+    uint8_t read[] = { ADDRESS << 1, 0x30, ADDRESS << 1 | 1, 'a', 'b' };
+    uint8_t data[3];
+
+    reset();
+    Wire.setPEC(true);
+    write[3] = crc8(0, write, 3);
+    SIM_EQUAL(sim_write_to(ADDRESS, write + 1, 3), 3);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxNumBytes, 2);
+    SIM_EQUAL(rxCount, 2);
+    SIM_CHECK(memcmp(rxData, write + 1, 2) == 0);
+    write[3] ^= 1;
+    SIM_EQUAL(sim_write_to(ADDRESS, write + 1, 3), 3);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(Wire.getPECErrors(), 1);
+
+    response = "ab";
+    SIM_EQUAL(sim_write_to(ADDRESS, &read[1], 1, false), 1);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_EQUAL(data[0], 'a');
+    SIM_EQUAL(data[1], 'b');
+    SIM_EQUAL(data[2], crc8(0, read, sizeof(read)));
+    Wire.setPEC(false);
+}
+
+static void requestBlockEvent(void)
+{
+    Wire.writeBlock((const uint8_t*)"xyz", 3);
+}
+
+static uint8_t blockCount;
+
+static void receiveBlockEvent(size_t numBytes)
+{
+    receives++;
+    blockCount = Wire.readBlock(rxData, 2);
+}
+
+// a block goes with its byte count; readBlock() stores no more than it is given room for
+static void test_smbus_block(void)
+{
+    const uint8_t write[] = { 3, 7, 8, 9 };
+    uint8_t data[4];
+
+    reset();
+    Wire.onRequest(requestBlockEvent);
+    Wire.onReceive(receiveBlockEvent);
+    SIM_CHECK(sim_read_from(ADDRESS, data, sizeof(data)));
+    SIM_CHECK(memcmp(data, "\x03xyz", 4) == 0);
+    rxData[2] = 0;
+    SIM_EQUAL(sim_write_to(ADDRESS, write, sizeof(write)), sizeof(write));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(blockCount, 3);
+    SIM_EQUAL(rxData[0], 7);
+    SIM_EQUAL(rxData[1], 8);
+    SIM_EQUAL(rxData[2], 0);
+}
+
+// a transaction with no bus activity for I2C_SMBUS_TIMEOUT ms is dropped, and the next one is served
+static void test_smbus_timeout(void)
+{
+    const uint8_t data[] = { 4, 5 };
+
+    reset();
+    SIM_CHECK(sim_start(ADDRESS, false));
+    SIM_CHECK(sim_write(1));
+    SIM_CHECK(!Wire.checkTimeout());
+    sim_advance_us((I2C_SMBUS_TIMEOUT - 1) * 1000UL);
+    SIM_CHECK(!Wire.checkTimeout());
+    sim_advance_us(2000);
+    SIM_CHECK(Wire.checkTimeout());
+    sim_stop();
+    SIM_EQUAL(receives, 0);
+    SIM_EQUAL(sim_write_to(ADDRESS, data, sizeof(data)), sizeof(data));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxCount, 2);
+    SIM_CHECK(!Wire.checkTimeout());
+}
+#endif
+
+#if defined(I2C_STATS)
+static boolean nackEvent(uint16_t address, uint8_t startCount)
+{
+    return false;
+}
+
+static void test_stats(void)
+{
+    const uint8_t write[] = { 1, 2, 3 };
+    uint8_t data[3];
+    struct i2cStats s;
+
+    reset();
+    response = "ab";
+    Wire.getStats(&s, true);
+    SIM_EQUAL(sim_write_to(ADDRESS, write, sizeof(write)), sizeof(write));
+    SIM_EQUAL(sim_write_to(ADDRESS, write, 1, false), 1);
+    SIM_CHECK(sim_read_from(ADDRESS, data, 3)); // the last byte is an underrun
+    SIM_CHECK(sim_start(ADDRESS, false));
+    sim_bus_error();
+    SIM_CHECK(sim_start(ADDRESS, true));
+    sim_read(true);
+    sim_collision();
+    sim_stop();
+    Wire.onAddrReceive(nackEvent);
+    SIM_CHECK(!sim_start(ADDRESS, false));
+    sim_stop();
+    Wire.getStats(&s, true);
+    SIM_EQUAL(s.transactions, 5); // the NACKed one too
+    SIM_EQUAL(s.repeatedStarts, 1);
+    SIM_EQUAL(s.rxBytes, 4);
+    SIM_EQUAL(s.txBytes, 3);
+    SIM_EQUAL(s.underruns, 1);
+    SIM_EQUAL(s.busErrors, 1);
+    SIM_EQUAL(s.collisions, 1);
+    SIM_EQUAL(s.nacks, 1);
+    SIM_CHECK(s.interrupts >= 15);
+    Wire.getStats(&s);
+    SIM_EQUAL(s.transactions, 0);
+    SIM_EQUAL(s.interrupts, 0);
+}
+#endif
+
+#if defined(I2C_TRACE_LENGTH)
+// keeps what dumpTrace() prints
+class TraceText : public Print
+{
+public:
+    char text[1024];
+    size_t length;
+
+    TraceText() : length(0) { text[0] = 0; }
+    virtual size_t write(uint8_t c)
+    {
+        if (length + 1 < sizeof(text)) {
+            text[length++] = c;
+            text[length] = 0;
+        }
+        return 1;
+    }
+};
+
+// dumps the trace and parses it into the type (ticks masked) and value of each record
+static unsigned trace_records(uint8_t* type, uint8_t* value, unsigned max, boolean clear)
+{
+    TraceText out;
+    unsigned count = 0, n = 0;
+    const char* p;
+
+    Wire.dumpTrace(out, clear);
+    SIM_CHECK(sscanf(out.text, "I2CTRACE %u", &count) == 1);
+    p = strchr(out.text, '\n') + 1;
+    while (n < count && n < max) {
+        unsigned record;
+        if (*p == '\r' || *p == '\n') {
+            p++;
+            continue;
+        }
+        SIM_CHECK(sscanf(p, "%4x", &record) == 1);
+        type[n] = (record >> 8) & ~I2C_TRACE_TICKS;
+        value[n] = record & 0xFF;
+        n++;
+        p += 4;
+    }
+    while (*p == '\r' || *p == '\n') p++;
+    SIM_CHECK(strncmp(p, "END", 3) == 0);
+    return count;
+}
+
+static void test_trace(void)
+{
+    const uint8_t write[] = { 0x11, 0x22 };
+    const uint8_t types[] = { I2C_TRACE_START, I2C_TRACE_RX, I2C_TRACE_RX, I2C_TRACE_STOP,
+                              I2C_TRACE_START, I2C_TRACE_TX, I2C_TRACE_STOP };
+    const uint8_t values[] = { ADDRESS << 1, 0x11, 0x22, 0, ADDRESS << 1 | 1, 'a', 0 };
+    uint8_t type[I2C_TRACE_LENGTH], value[I2C_TRACE_LENGTH];
+    uint8_t data;
+
+    reset();
+    response = "a";
+    trace_records(type, value, I2C_TRACE_LENGTH, true);
+    SIM_EQUAL(sim_write_to(ADDRESS, write, sizeof(write)), sizeof(write));
+    SIM_CHECK(sim_read_from(ADDRESS, &data, 1));
+    SIM_EQUAL(trace_records(type, value, I2C_TRACE_LENGTH, false), sizeof(types));
+    SIM_EQUAL(trace_records(type, value, I2C_TRACE_LENGTH, true), sizeof(types));
+    SIM_CHECK(memcmp(type, types, sizeof(types)) == 0);
+    SIM_CHECK(memcmp(value, values, sizeof(values)) == 0);
+    SIM_EQUAL(trace_records(type, value, I2C_TRACE_LENGTH, false), 0);
+    // the ring keeps the last I2C_TRACE_LENGTH records
+    for (int i = 0; i < I2C_TRACE_LENGTH; i++) {
+        SIM_CHECK(sim_read_from(ADDRESS, &data, 1));
+    }
+    SIM_EQUAL(trace_records(type, value, I2C_TRACE_LENGTH, true), I2C_TRACE_LENGTH);
+    SIM_EQUAL(type[I2C_TRACE_LENGTH - 1], I2C_TRACE_STOP);
+}
+#endif
+
+#if defined(I2C_SLEEP)
+static void wakeByWrite(void)
+{
+    const uint8_t data = 0x5A;
+
+    SIM_EQUAL(Wire.i2c->sleeping, 1);
+    SIM_EQUAL(sim_write_to(ADDRESS, &data, 1), 1);
+    SIM_EQUAL(Wire.i2c->sleeping, 0); // cleared by the first interrupt
+}
+
+static void wakeByByte(void)
+{
+    SIM_EQUAL(Wire.i2c->sleeping, 0);
+    SIM_CHECK(sim_write(0x5B));
+}
+
+// power-down between transactions, from which an address match wakes; idle within a transaction
+static void test_sleep(void)
+{
+    reset();
+    sim_wake = wakeByWrite;
+    SIM_EQUAL(Wire.sleepUntilActivity(), I2C_SLEEP_MODE);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxData[0], 0x5A);
+    SIM_CHECK(SREG & _BV(SREG_I));
+
+    SIM_CHECK(sim_start(ADDRESS, false));
+    sim_wake = wakeByByte;
+    SIM_EQUAL(Wire.sleepUntilActivity(), SLEEP_MODE_IDLE);
+    sim_stop();
+    SIM_EQUAL(receives, 2);
+    SIM_EQUAL(rxData[1], 0x5B);
+    sim_wake = NULL;
+}
+#endif
+
+#if defined(I2C_TENBIT_TABLE)
+// a 10-bit write: header, second address byte, and data; STOP follows unless stop is false
+// return: true if both address bytes are ACKed
+static boolean tenbit_write(uint16_t address, const uint8_t* data, size_t length, boolean stop = true)
+{
+    boolean ack = sim_start(0x78 | (address >> 8), false) && sim_write(address & 0xFF);
+
+    for (size_t i = 0; ack && i < length; i++) {
+        sim_write(data[i]);
+    }
+    if (stop) sim_stop();
+    return ack;
+}
+
+// only the 10-bit address of the table is ACKed, and the STOP of another 10-bit device's write is ignored
+static void test_tenbit_table(void)
+{
+    const uint8_t data[] = { 1, 2, 3 };
+    uint8_t in[2];
+
+    reset();
+    Wire.begin(0x78, B0110); // all 10-bit headers match in hardware
+    Wire.setTenBitAddress(0x123);
+    SIM_CHECK(tenbit_write(0x123, data, sizeof(data)));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxNumBytes, sizeof(data));
+    SIM_CHECK(!tenbit_write(0x124, data, 1)); // second address byte NACKed
+    SIM_EQUAL(receives, 1);
+    SIM_CHECK(!tenbit_write(0x223, data, 1)); // header NACKed
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxCount, sizeof(data));
+    SIM_CHECK(tenbit_write(0x123, data, 2));
+    SIM_EQUAL(receives, 2);
+    SIM_EQUAL(rxNumBytes, 2);
+
+    // the read header after repeated START is ACKed only for the device just addressed
+    response = "rd";
+    SIM_CHECK(tenbit_write(0x123, NULL, 0, false));
+    SIM_CHECK(sim_read_from(0x79, in, 2));
+    SIM_CHECK(memcmp(in, "rd", 2) == 0);
+    SIM_EQUAL(addrStartCount, 1);
+    SIM_CHECK(tenbit_write(0x123, NULL, 0, false));
+    SIM_CHECK(!sim_read_from(0x7A, in, 2));
+    SIM_EQUAL(requests, 1);
+    Wire.setTenBitAddress((const uint16_t*)NULL, 0);
+}
+#endif
+
+#if I2C_DEVICE_TABLE_LENGTH >= 2
+static struct i2cDevice deviceA, deviceB;
+
+static void requestA(void) { Wire.write('A'); }
+static void requestB(void) { Wire.write('B'); }
+
+// addresses sharing a table entry are told apart, and the second one is refused
+static void test_device_table(void)
+{
+    const uint8_t a = 0x50, b = a + I2C_DEVICE_TABLE_LENGTH;
+    uint8_t data;
+
+    reset();
+    Wire.begin(a, (a ^ b) << 1); // both addresses match in hardware
+    deviceA.onRequest = requestA;
+    deviceB.onRequest = requestB;
+    SIM_CHECK(Wire.setDevice(a, &deviceA));
+    SIM_CHECK(!Wire.setDevice(b, &deviceB));
+    SIM_CHECK(sim_read_from(a, &data, 1));
+    SIM_EQUAL(data, 'A');
+    SIM_CHECK(!sim_read_from(b, &data, 1));
+    SIM_CHECK(Wire.setDevice(a, NULL)); // frees the entry
+    SIM_CHECK(!sim_read_from(a, &data, 1));
+    SIM_CHECK(Wire.setDevice(b, &deviceB));
+    SIM_CHECK(!Wire.setDevice(a, &deviceA));
+    SIM_CHECK(sim_read_from(b, &data, 1));
+    SIM_EQUAL(data, 'B');
+    SIM_CHECK(!sim_read_from(a, &data, 1));
+    SIM_CHECK(Wire.setDevice(b, NULL));
+}
+
+// the STOP of a write NACKed for want of a device is not taken as the end of the write before it
+static void test_device_nack(void)
+{
+    const uint8_t a = 0x50;
+    const uint8_t data[] = { 1, 2, 3 };
+
+    reset();
+    Wire.begin(a, 1 << 1); // a and a + 1 match in hardware
+    deviceA.onReceive = receiveEvent;
+    SIM_CHECK(Wire.setDevice(a, &deviceA));
+    SIM_EQUAL(sim_write_to(a, data, sizeof(data)), sizeof(data));
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(sim_write_to(a + 1, data, 1), 0);
+    SIM_EQUAL(receives, 1);
+    SIM_EQUAL(rxCount, sizeof(data));
+    SIM_EQUAL(sim_write_to(a, data, 2), 2);
+    SIM_EQUAL(receives, 2);
+    SIM_EQUAL(rxNumBytes, 2);
+    SIM_CHECK(Wire.setDevice(a, NULL));
+    deviceA.onReceive = NULL;
+}
+
+#if defined(I2C_GENERAL_CALL) && defined(I2C_REGISTER_MAP)
+static volatile uint8_t sharedRegs[4];
+static volatile uint8_t ownRegs[4];
+static struct i2cDevice broadcast, own;
+
+// the general call has a device of its own, apart from the table entry 0 of 0x08
+static void test_general_call_device(void)
+{
+    const uint8_t write[] = { 1, 0x5A };
+    uint8_t data;
+
+    own.regs = ownRegs;
+    own.regSize = sizeof(ownRegs);
+    broadcast.regs = sharedRegs;
+    broadcast.regSize = sizeof(sharedRegs);
+    Wire.begin(0x08);
+    SIM_CHECK(Wire.setDevice(0x08, &own));
+    SIM_CHECK(Wire.setDevice(0, &broadcast));
+    Wire.setGeneralCall(true);
+    SIM_EQUAL(sim_write_to(0, write, sizeof(write)), sizeof(write));
+    SIM_EQUAL(sharedRegs[1], 0x5A);
+    SIM_EQUAL(ownRegs[1], 0);
+    SIM_EQUAL(sim_write_to(0x08, write, 1, false), 1);
+    SIM_CHECK(sim_read_from(0x08, &data, 1));
+    SIM_EQUAL(data, 0);
+    Wire.setGeneralCall(false);
+}
+#endif
+#endif
+
+int main(void)
+{
+    test_write();
+    test_address_mismatch();
+    test_read();
+    test_repeated_start();
+    test_overrun();
+    test_errors();
+    test_typed();
+#if defined(I2C_RX_STREAMING)
+    test_rx_streaming();
+    test_rx_nested();
+#endif
+#if defined(I2C_TX_STREAMING)
+    test_tx_streaming();
+    test_tx_nested();
+#endif
+#if defined(I2C_DEFERRED) && defined(I2C_TX_SOURCE)
+    test_deferred_source();
+#endif
+#if defined(I2C_TENBIT_TABLE)
+    test_tenbit_table();
+#endif
+#if defined(I2C_REGISTER_MAP)
+    test_register_map();
+#endif
+#if defined(I2C_SNAPSHOT) && defined(I2C_TX_SOURCE)
+    test_snapshot();
+#endif
+#if defined(I2C_SMBUS)
+    test_smbus_pec();
+    test_smbus_block();
+    test_smbus_timeout();
+#endif
+#if defined(I2C_STATS)
+    test_stats();
+#endif
+#if defined(I2C_TRACE_LENGTH)
+    test_trace();
+#endif
+#if defined(I2C_SLEEP)
+    test_sleep();
+#endif
+#if I2C_DEVICE_TABLE_LENGTH >= 2
+    // the device table stays in use from here on
+    test_device_table();
+    test_device_nack();
+#if defined(I2C_GENERAL_CALL) && defined(I2C_REGISTER_MAP)
+    test_general_call_device();
+#endif
+#endif
+    return sim_report("test_core");
+}
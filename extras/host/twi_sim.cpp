@@ -0,0 +1,476 @@
+/*
+    twi_sim - simulated TWI slave peripheral of ATtiny441/841 for running WireS on the host
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <avr/eeprom.h>
+#include <core_adc.h>
+#include "twi_sim.h"
+
+volatile uint8_t TWSCRA, TWSCRB, TWSSRA, TWSA, TWSAM, TWSD;
+volatile uint8_t SREG = _BV(SREG_I), PORTA; // the main program runs with interrupts enabled
+
+struct simStats sim_stats;
+unsigned long sim_bus_hz = 100000;
+void (*sim_idle)(void);
+void (*sim_wake)(void);
+uint8_t sim_held_result;
+unsigned sim_failures;
+uint8_t sim_eeprom[E2END + 1];
+
+uint16_t sim_adc_value;
+adc_ic_t sim_adc_channel;
+unsigned sim_adc_starts;
+
+extern "C" void TWI_SLAVE_vect(void);
+
+#define SIM_EEPROM_WRITE_US 3400 // EEPROM erase and write cycle
+#define SIM_HOLD_LIMIT      1000 // sim_idle() calls before a held SCL is taken as a hang
+
+// bus as seen by the slave
+#define BUS_IDLE     0 // no transaction, or another slave's
+#define BUS_ACTIVE   1 // addressed; the slave takes part in each byte
+#define BUS_RELEASED 2 // the slave waits for the next START (NACK, end of data, or master NACK)
+
+// bus event held while SCL is held within the ISR (see sim_interrupt())
+#define HELD_NONE  0
+#define HELD_START 1
+#define HELD_WRITE 2
+#define HELD_READ  3
+#define HELD_STOP  4
+#define SIM_HELD   0x80 // returned instead of a TWSCRB command
+
+static uint8_t bus = BUS_IDLE;
+static uint8_t dir;                     // TWDIR of the last address match
+static uint8_t depth;                   // nesting of the ISR
+static uint8_t held = HELD_NONE;
+static uint8_t heldData;                // address or data byte of the held event
+static boolean heldRead;                // direction of a held START
+static unsigned long long simUs;        // simulated time
+static unsigned long long eepromReadyUs; // end of the EEPROM write cycle
+
+// ------------------------------------------------------------------------------------------------------
+// Clocks
+//
+static unsigned long long sim_host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// host clock in ticks of 16MHz, as TCNT1 without prescaler
+uint16_t sim_timer(void)
+{
+    return (uint16_t)(sim_host_ns() * 16 / 1000);
+}
+
+void sim_advance_us(unsigned long us)
+{
+    simUs += us;
+}
+
+// time of bits on the bus
+static void sim_bits(uint8_t bits)
+{
+    sim_stats.busNs += bits * 1000000000ULL / sim_bus_hz;
+    simUs += (bits * 1000000ULL + sim_bus_hz - 1) / sim_bus_hz;
+}
+
+unsigned long millis(void) { return (unsigned long)(simUs / 1000); }
+unsigned long micros(void) { return (unsigned long)simUs; }
+void delay(unsigned long ms) { simUs += ms * 1000ULL; }
+
+// ------------------------------------------------------------------------------------------------------
+// EEPROM - a write keeps EEPROM busy for SIM_EEPROM_WRITE_US; an access meanwhile waits as avr-libc does
+//
+int eeprom_is_ready(void)
+{
+    return simUs >= eepromReadyUs;
+}
+
+void eeprom_busy_wait(void)
+{
+    if (simUs < eepromReadyUs) simUs = eepromReadyUs;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* p)
+{
+    eeprom_busy_wait();
+    return sim_eeprom[(uintptr_t)p & E2END];
+}
+
+void eeprom_write_byte(uint8_t* p, uint8_t value)
+{
+    eeprom_busy_wait();
+    sim_eeprom[(uintptr_t)p & E2END] = value;
+    eepromReadyUs = simUs + SIM_EEPROM_WRITE_US;
+}
+
+void eeprom_update_byte(uint8_t* p, uint8_t value)
+{
+    if (eeprom_read_byte(p) != value) eeprom_write_byte(p, value);
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Interrupt - raise the flags of a bus event and run the ISR with the I bit of SREG cleared, as the CPU
+//             does.  While the interrupt is masked (by its enable bit or the I bit) SCL is held: at the top
+//             level sim_idle() stands for the main program meanwhile; within the ISR (a master function
+//             called by a handler, as the bus goes on while a streaming handler runs) the event is held
+//             and played when the outermost ISR has returned.  The command and data byte of an ISR take
+//             effect as it writes them, so those of a nested ISR don't overwrite them.
+// return: command written to TWSCRB by the ISR, 0 if none, or SIM_HELD
+// parameters:
+//      data = where to store TWSD as the ISR leaves it, or NULL
+//
+static uint8_t sim_interrupt(uint8_t flags, uint8_t enable, uint8_t* data = NULL)
+{
+    for (unsigned n = 0; !(TWSCRA & _BV(enable)) || !(SREG & _BV(SREG_I)); n++) {
+        if (n == 0) sim_stats.holds++;
+        if (depth) {
+            return SIM_HELD;
+        }
+        if (sim_idle == NULL || n == SIM_HOLD_LIMIT) {
+            sim_fail(__FILE__, __LINE__, "SCL held with the interrupt masked");
+            return 0;
+        }
+        sim_idle();
+    }
+    uint8_t outerStatus = TWSSRA, outerCommand = TWSCRB, outerData = TWSD;
+    TWSSRA = flags | (dir ? _BV(TWDIR) : 0);
+    TWSCRB = 0;
+    uint8_t sreg = SREG;
+    SREG &= ~_BV(SREG_I);
+    depth++;
+    unsigned long long start = sim_host_ns();
+    TWI_SLAVE_vect();
+    unsigned long time = (unsigned long)(sim_host_ns() - start);
+    depth--;
+    SREG = sreg; // reti
+    uint8_t command = TWSCRB & (_BV(TWAA) | _BV(TWCMD1) | _BV(TWCMD0));
+    if (data != NULL) {
+        *data = TWSD;
+    }
+    if (depth) {
+        TWSSRA = outerStatus;
+        TWSCRB = outerCommand;
+        TWSD = outerData;
+    }
+    sim_stats.isrCalls++;
+    sim_stats.isrNs += time;
+    if (time > sim_stats.isrMaxNs) {
+        sim_stats.isrMaxNs = time;
+    }
+    return command;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Data interrupt - the ISR may hold SCL by masking TWDIE without a command; TWDIF stays set then and
+//                  the interrupt comes again once TWDIE is set
+// return: command written to TWSCRB, or SIM_HELD
+// parameters:
+//      data = where to store TWSD as the ISR leaves it, or NULL
+//
+static uint8_t sim_data_interrupt(uint8_t* data = NULL)
+{
+    uint8_t command;
+
+    while ((command = sim_interrupt(_BV(TWDIF) | _BV(TWAS), TWDIE, data)) == 0) {
+        if ((TWSCRA & _BV(TWDIE))) {
+            sim_fail(__FILE__, __LINE__, "no response to data interrupt");
+            return B0110;
+        }
+    }
+    if (command != SIM_HELD) {
+        sim_stats.dataEvents++; // counted when the byte is done
+    }
+    return command;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Address match - TWSAM is the mask of TWSA, or the second address if TWAE is set; the LSB of TWSA
+//                 enables the general call address
+//
+static boolean sim_match(uint8_t address)
+{
+    if (!(TWSCRA & _BV(TWEN))) return false;
+    if (address == 0) return (TWSA & 1);
+    if ((TWSAM & _BV(TWAE))) {
+        return address == (TWSA >> 1) || address == (TWSAM >> 1);
+    }
+    return ((address ^ (TWSA >> 1)) & ~(TWSAM >> 1) & 0x7F) == 0;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Bus events - as seen by the slave once the bits are on the bus
+//
+static boolean sim_start_event(uint8_t address, boolean read)
+{
+    if (!sim_match(address)) {
+        bus = BUS_IDLE; // another slave's; the STOP is still seen
+        return false;
+    }
+    dir = read;
+    TWSD = (address << 1) | (read ? 1 : 0);
+    uint8_t command = sim_interrupt(_BV(TWASIF) | _BV(TWAS), TWASIE);
+    if (command == SIM_HELD) {
+        held = HELD_START;
+        heldData = address;
+        heldRead = read;
+        return true;
+    }
+    sim_stats.addrEvents++;
+    if (command == 0) {
+        sim_fail(__FILE__, __LINE__, "no response to address");
+    }
+    if ((command & (_BV(TWAA) | _BV(TWCMD1) | _BV(TWCMD0))) != B0011) {
+        sim_stats.nacks++;
+        bus = BUS_RELEASED;
+        return false;
+    }
+    sim_stats.transactions++;
+    bus = BUS_ACTIVE;
+    return true;
+}
+
+static boolean sim_write_event(uint8_t data)
+{
+    if (bus != BUS_ACTIVE || dir) return false;
+    TWSD = data;
+    uint8_t command = sim_data_interrupt();
+    if (command == SIM_HELD) {
+        held = HELD_WRITE;
+        heldData = data;
+        return true;
+    }
+    if ((command & _BV(TWCMD0)) == 0) {
+        bus = BUS_RELEASED; // complete transaction; the next bytes are not acknowledged
+    }
+    if ((command & _BV(TWAA))) {
+        sim_stats.nacks++;
+        bus = BUS_RELEASED;
+        return false;
+    }
+    sim_stats.bytes++;
+    return true;
+}
+
+static uint8_t sim_read_event(boolean ack)
+{
+    if (bus != BUS_ACTIVE || !dir) return 0xFF;
+    uint8_t data;
+    uint8_t command = sim_data_interrupt(&data);
+    if (command == SIM_HELD) {
+        held = HELD_READ;
+        heldRead = ack;
+        return 0xFF;
+    }
+    if ((command & _BV(TWCMD0)) == 0) {
+        bus = BUS_RELEASED; // no data; SDA stays high
+        return 0xFF;
+    }
+    sim_stats.bytes++;
+    if (!ack) {
+        bus = BUS_RELEASED; // master NACK; the slave waits for STOP or repeated START
+    }
+    return data;
+}
+
+static void sim_stop_event(void)
+{
+    if ((TWSCRA & _BV(TWSIE)) && (TWSCRA & _BV(TWEN))) {
+        // TWSIE makes every STOP on the bus raise TWASIF
+        if (sim_interrupt(_BV(TWASIF), TWASIE) == SIM_HELD) {
+            held = HELD_STOP;
+            return;
+        }
+        sim_stats.stopEvents++;
+    }
+    bus = BUS_IDLE;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Held event - played once the outermost ISR has returned; its result is left in sim_held_result
+//
+static void sim_play_held(void)
+{
+    while (depth == 0 && held != HELD_NONE) {
+        uint8_t event = held;
+        held = HELD_NONE;
+        switch (event) {
+        case HELD_START:
+            sim_held_result = sim_start_event(heldData, heldRead);
+            break;
+        case HELD_WRITE:
+            sim_held_result = sim_write_event(heldData);
+            break;
+        case HELD_READ:
+            sim_held_result = sim_read_event(heldRead);
+            break;
+        case HELD_STOP:
+            sim_stop_event();
+            break;
+        }
+    }
+}
+
+// the master can't go on while SCL is held
+static boolean sim_bus_free(const char* what)
+{
+    if (held == HELD_NONE) return true;
+    sim_fail(__FILE__, __LINE__, what);
+    return false;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Bus master
+//
+boolean sim_start(uint8_t address, boolean read)
+{
+    if (!sim_bus_free("START while SCL is held")) return false;
+    sim_bits(10); // (repeated) START and address byte
+    boolean ack = sim_start_event(address, read);
+    sim_play_held();
+    return ack;
+}
+
+boolean sim_write(uint8_t data)
+{
+    if (!sim_bus_free("write while SCL is held")) return false;
+    sim_bits(9);
+    boolean ack = sim_write_event(data);
+    sim_play_held();
+    return ack;
+}
+
+uint8_t sim_read(boolean ack)
+{
+    if (!sim_bus_free("read while SCL is held")) return 0xFF;
+    sim_bits(9);
+    uint8_t data = sim_read_event(ack);
+    sim_play_held();
+    return data;
+}
+
+void sim_stop(void)
+{
+    if (!sim_bus_free("STOP while SCL is held")) return;
+    sim_bits(1);
+    sim_stop_event();
+    sim_play_held();
+}
+
+void sim_bus_error(void)
+{
+    sim_stats.errorEvents++;
+    sim_interrupt(_BV(TWBE) | _BV(TWASIF), TWASIE);
+    bus = BUS_IDLE;
+}
+
+void sim_collision(void)
+{
+    sim_stats.errorEvents++;
+    sim_interrupt(_BV(TWC) | _BV(TWDIF) | _BV(TWAS), TWDIE);
+    bus = BUS_RELEASED;
+}
+
+size_t sim_write_to(uint8_t address, const uint8_t* data, size_t length, boolean stop)
+{
+    size_t n = 0;
+
+    if (sim_start(address, false)) {
+        while (n < length && sim_write(data[n])) n++;
+    }
+    if (stop) sim_stop();
+    return n;
+}
+
+boolean sim_read_from(uint8_t address, uint8_t* data, size_t length, boolean stop)
+{
+    boolean ack = sim_start(address, true);
+
+    if (ack) {
+        for (size_t i = 0; i < length; i++) {
+            data[i] = sim_read(i + 1 < length);
+        }
+    }
+    if (stop) sim_stop();
+    return ack;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Sleep - sleep_cpu() returns once sim_wake() has played the bus events that wake the device
+//
+void sim_sleep_cpu(void)
+{
+    if (sim_wake != NULL) {
+        sim_wake();
+    }
+}
+
+void sim_clear_stats(void)
+{
+    memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Handler timing
+//
+simHandlerTimer::simHandlerTimer()
+{
+    start = sim_host_ns();
+}
+
+simHandlerTimer::~simHandlerTimer()
+{
+    sim_stats.handlerCalls++;
+    sim_stats.handlerNs += sim_host_ns() - start;
+}
+
+// ------------------------------------------------------------------------------------------------------
+// Checks
+//
+void sim_fail(const char* file, int line, const char* what)
+{
+    sim_failures++;
+    fprintf(stderr, "%s:%d: failed: %s\n", file, line, what);
+}
+
+void sim_fail_equal(const char* file, int line, const char* what, long value, long expected)
+{
+    sim_failures++;
+    fprintf(stderr, "%s:%d: failed: %s is %ld, expected %ld\n", file, line, what, value, expected);
+}
+
+int sim_report(const char* name)
+{
+    if (sim_failures) {
+        printf("%s: %u failed\n", name, sim_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
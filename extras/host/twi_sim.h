@@ -0,0 +1,110 @@
+/*
+    twi_sim - simulated TWI slave peripheral of ATtiny441/841 for running WireS on the host
+    Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// The functions below play the bus master.  Each bus event sets TWSSRA and TWSD as the hardware does
+// and calls the TWI slave ISR of WireS, then takes the response from TWSCRB (ACK, NACK, or releasing
+// the bus) and TWSD.  The address is matched against TWSA and TWSAM first, as the hardware does.
+// Simulated time advances by nine SCL periods per byte; the ISR itself is timed by the host clock.
+// The ISR runs with the I bit of SREG cleared, and cli() and sei() of the handlers mask and unmask it.
+
+#ifndef TWI_SIM_H
+#define TWI_SIM_H
+
+#include <Arduino.h>
+
+// ------------------------------------------------------------------------------------------------------
+// Counters - cleared by sim_clear_stats()
+//
+struct simStats
+{
+    unsigned long isrCalls;      // ISR invocations
+    unsigned long addrEvents;    // address matches (incl. repeated START)
+    unsigned long dataEvents;    // data byte interrupts
+    unsigned long stopEvents;    // STOP interrupts
+    unsigned long errorEvents;   // bus error and collision interrupts
+    unsigned long transactions;  // address matches ACKed
+    unsigned long nacks;         // addresses and data bytes NACKed by the slave
+    unsigned long bytes;         // data bytes moved (ACKed writes and reads)
+    unsigned long holds;         // times SCL was held with the interrupt masked
+    unsigned long long busNs;    // simulated time of the bits on the bus
+    unsigned long long isrNs;    // time spent in the ISR
+    unsigned long isrMaxNs;      // longest ISR
+    unsigned long handlerCalls;  // handlers timed by SIM_HANDLER
+    unsigned long long handlerNs; // time spent in them
+};
+extern struct simStats sim_stats;
+
+// ------------------------------------------------------------------------------------------------------
+// Bus master
+//
+extern unsigned long sim_bus_hz;         // SCL frequency for simulated time (100000 by default)
+
+boolean sim_start(uint8_t address, boolean read); // START, or repeated START within a transaction
+                                                  // return: true if the address is ACKed
+boolean sim_write(uint8_t data);                  // return: true if ACKed
+uint8_t sim_read(boolean ack);                    // ack = false for the last byte of the read
+void sim_stop(void);
+void sim_bus_error(void);                         // misplaced START or STOP
+void sim_collision(void);                         // slave lost arbitration while sending
+
+// a whole transaction; a repeated START follows when stop is false
+// return: number of bytes ACKed (write), or false if the address is NACKed (read)
+size_t sim_write_to(uint8_t address, const uint8_t* data, size_t length, boolean stop = true);
+boolean sim_read_from(uint8_t address, uint8_t* data, size_t length, boolean stop = true);
+
+// called while SCL is held with the interrupt masked, as loop() would run meanwhile
+extern void (*sim_idle)(void);
+
+// A master function called by a handler plays a bus event that comes in while the handler runs; the ISR
+// nests if the handler runs with interrupts enabled.  If SCL is held instead (the interrupt is masked),
+// the function returns at once (true, or 0xFF for a read), the event is played after the outermost ISR
+// has returned, and its result (ACK or data byte) is left in sim_held_result.
+extern uint8_t sim_held_result;
+
+// called by sleep_cpu(); the bus events it plays stand for what wakes the device
+extern void (*sim_wake)(void);
+
+void sim_clear_stats(void);
+void sim_advance_us(unsigned long us);
+
+// ------------------------------------------------------------------------------------------------------
+// Handler timing - put SIM_HANDLER; at the top of a handler to count its calls and time
+//
+struct simHandlerTimer
+{
+    simHandlerTimer();
+    ~simHandlerTimer();
+    unsigned long long start;
+};
+#define SIM_HANDLER simHandlerTimer sim_handler_timer_
+
+// ------------------------------------------------------------------------------------------------------
+// Checks
+//
+extern unsigned sim_failures;
+#define SIM_CHECK(cond) do { if (!(cond)) sim_fail(__FILE__, __LINE__, #cond); } while (0)
+#define SIM_EQUAL(a, b) do { long a_ = (long)(a), b_ = (long)(b); \
+                             if (a_ != b_) sim_fail_equal(__FILE__, __LINE__, #a, a_, b_); } while (0)
+void sim_fail(const char* file, int line, const char* what);
+void sim_fail_equal(const char* file, int line, const char* what, long value, long expected);
+int sim_report(const char* name); // return: exit status
+
+extern uint8_t sim_eeprom[E2END + 1];
+
+#endif
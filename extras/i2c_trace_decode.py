@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+#   i2c_trace_decode - decode a WireS bus event trace
+#   Copyright (c) 2015 by Hisashi Ito (info at mewpro.cc)
+#
+#   This library is free software; you can redistribute it and/or
+#   modify it under the terms of the GNU Lesser General Public
+#   License as published by the Free Software Foundation; either
+#   version 2.1 of the License, or (at your option) any later version.
+#
+# The input is either the text printed by Wire.dumpTrace() (e.g. captured from the serial monitor)
+# or, with --binary, the bytes a master read from I2C_TRACE_REGISTER (number of records, then records).
+#
+# usage: i2c_trace_decode.py [--binary] [--tick-us US] [--vcd OUT.vcd] [INPUT]
+#
+# The timeline is printed to stdout.  --vcd also writes the events as a Value Change Dump, which
+# GTKWave and sigrok (PulseView: Import > Value Change Dump) open, so that the event timing can be
+# profiled or fed to a simulator.
+
+import argparse
+import sys
+
+START, RESTART, RX, TX, STOP, NACK, ERROR, UNDERRUN = range(8)
+NAMES = ["START", "RESTART", "RX", "TX", "STOP", "NACK", "ERROR", "UNDERRUN"]
+TICKS_MAX = 0x1F
+
+# TWSSRA bits
+TWSSRA_BITS = [(0x80, "TWDIF"), (0x40, "TWASIF"), (0x20, "TWCH"), (0x10, "TWRA"),
+               (0x08, "TWC"), (0x04, "TWBE"), (0x02, "TWDIR"), (0x01, "TWAS")]
+
+
+def parse_text(text):
+    lines = [l.strip() for l in text.splitlines()]
+    try:
+        first = next(i for i, l in enumerate(lines) if l.startswith("I2CTRACE"))
+    except StopIteration:
+        sys.exit("no I2CTRACE header found")
+    count = int(lines[first].split()[1])
+    data = bytearray()
+    for l in lines[first + 1:]:
+        if l == "END":
+            break
+        data += bytes.fromhex(l)
+    if len(data) != count * 2:
+        sys.exit("trace is truncated: %d of %d records" % (len(data) // 2, count))
+    return data
+
+
+def parse_binary(data):
+    if not data:
+        sys.exit("empty trace")
+    count = data[0]
+    if len(data) < 1 + count * 2:
+        sys.exit("trace is truncated: %d of %d records" % ((len(data) - 1) // 2, count))
+    return data[1:1 + count * 2]
+
+
+def records(data):
+    time = 0
+    for i in range(0, len(data), 2):
+        kind, ticks, value = data[i] >> 5, data[i] & TICKS_MAX, data[i + 1]
+        time += ticks
+        yield time, ticks, kind, value
+
+
+def status_bits(value):
+    return "|".join(name for bit, name in TWSSRA_BITS if value & bit) or "0"
+
+
+def describe(kind, value, tenbit):
+    if kind in (START, RESTART):
+        if (value & 0xF8) == 0xF0:
+            return "header 0x%02X (10-bit, A9:A8=%d) %s" % (value, (value >> 1) & 3, "R" if value & 1 else "W")
+        return "address 0x%02X %s" % (value >> 1, "R" if value & 1 else "W")
+    if kind == RX and tenbit:
+        return "address low byte 0x%02X" % value
+    if kind in (RX, TX):
+        return "0x%02X" % value
+    if kind in (NACK, ERROR):
+        return "TWSSRA=%s" % status_bits(value)
+    return ""
+
+
+def timeline(data, tick_us, out):
+    tenbit = False
+    for time, ticks, kind, value in records(data):
+        delta = ("+>=%d" if ticks == TICKS_MAX else "+%d") % ticks
+        stamp = "%10.1fus" % (time * tick_us) if tick_us else "%8d" % time
+        out.write("%s %8s  %-8s %s\n" % (stamp, delta, NAMES[kind], describe(kind, value, tenbit)))
+        # the byte following a 10-bit write header is the rest of the address
+        tenbit = kind in (START, RESTART) and (value & 0xF9) == 0xF0
+
+
+def vcd(data, tick_us, out):
+    if tick_us:
+        out.write("$timescale 1ns $end\n")
+    else:
+        out.write("$comment time is in I2C_TRACE_TIMER ticks $end\n$timescale 1us $end\n")
+    out.write("$scope module wires $end\n")
+    out.write("$var wire 1 s start $end\n")
+    out.write("$var wire 1 p stop $end\n")
+    out.write("$var wire 1 n nack $end\n")
+    out.write("$var wire 1 e error $end\n")
+    out.write("$var wire 1 r read $end\n")
+    out.write("$var wire 8 a address $end\n")
+    out.write("$var wire 8 d data $end\n")
+    out.write("$upscope $end\n$enddefinitions $end\n")
+    out.write("#0\n0s\n0p\n0n\n0e\n0r\nbxxxxxxxx a\nbxxxxxxxx d\n")
+    scale = tick_us * 1000 if tick_us else 1
+    pulses = []
+    last = 0
+    time = 0
+    for time, ticks, kind, value in records(data):
+        t = int(time * scale)
+        if t > last:
+            out.write("#%d\n" % t)
+            last = t
+        # pulses of the previous record end where this one begins
+        out.write("".join("0%s\n" % c for c in pulses))
+        pulses = []
+        if kind in (START, RESTART):
+            out.write("1s\n%sr\nb%s a\n" % ("1" if value & 1 else "0", format(value, "08b")))
+            pulses.append("s")
+        elif kind in (RX, TX):
+            out.write("b%s d\n" % format(value, "08b"))
+        elif kind == STOP:
+            out.write("1p\n")
+            pulses.append("p")
+        elif kind in (NACK, UNDERRUN):
+            out.write("1n\n")
+            pulses.append("n")
+        elif kind == ERROR:
+            out.write("1e\n")
+            pulses.append("e")
+    if pulses:
+        out.write("#%d\n" % (last + 1) + "".join("0%s\n" % c for c in pulses))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode a WireS bus event trace")
+    ap.add_argument("input", nargs="?", help="trace file (stdin if omitted)")
+    ap.add_argument("--binary", action="store_true", help="input is the raw bytes read from I2C_TRACE_REGISTER")
+    ap.add_argument("--tick-us", type=float, default=0,
+                    help="microseconds per I2C_TRACE_TIMER tick (e.g. 8 for TCNT0 at 8MHz); ticks if omitted")
+    ap.add_argument("--vcd", metavar="FILE", help="also write a Value Change Dump")
+    args = ap.parse_args()
+
+    if args.binary:
+        raw = open(args.input, "rb").read() if args.input else sys.stdin.buffer.read()
+        data = parse_binary(raw)
+    else:
+        text = open(args.input).read() if args.input else sys.stdin.read()
+        data = parse_text(text)
+
+    timeline(data, args.tick_us, sys.stdout)
+    if args.vcd:
+        with open(args.vcd, "w") as f:
+            vcd(data, args.tick_us, f)
+
+
+if __name__ == "__main__":
+    main()